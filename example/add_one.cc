@@ -48,6 +48,7 @@ int main()
     AddOne addOne(writer);
 
     ParseError err = Reader::parse(is, addOne);
+    os.flush();
     if (err != PARSE_OK) {
         printf("%s\n", parseErrorStr(err));
     }
@@ -13,6 +13,7 @@ int main()
     Writer writer(os);
 
     ParseError err = Reader::parse(is, writer);
+    os.flush();
     if (err != PARSE_OK) {
         printf("%s\n", parseErrorStr(err));
     }
@@ -82,6 +82,7 @@ void file_stream_example() {
     FileWriteStream console_output(stdout);
     PrettyWriter console_writer(console_output);
     doc.writeTo(console_writer);
+    console_output.flush();
     
     // 清理测试文件
     std::remove(test_filename);
@@ -129,6 +130,7 @@ void mixed_stream_example() {
     FileWriteStream console_out(stdout);
     PrettyWriter console_writer(console_out);
     doc.writeTo(console_writer);
+    console_out.flush();
     
     // 4. 同时输出到字符串
     StringWriteStream string_out;
@@ -1,5 +1,7 @@
 #include <string>
+#include <vector>
 
+#include <hjson/Binding.h>
 #include <hjson/Value.h>
 #include <hjson/Document.h>
 #include <hjson/StringWriteStream.h>
@@ -48,6 +50,19 @@ struct Person
     int32_t age;
 };
 
+//
+// the same without a DOM: the binding parses into the members and writes
+// them back, see hjson/Binding.h
+//
+struct Team
+{
+    std::string name;
+    std::vector<std::string> members;
+    int32_t wins = 0;
+};
+
+HJSON_FIELDS(Team, name, members, wins)
+
 int main()
 {
     Value value(TYPE_OBJECT);
@@ -60,4 +75,17 @@ int main()
     FileWriteStream os(stdout);
     Writer writer(os);
     value.writeTo(writer);
+    os.put('\n');
+    os.flush();
+
+    Team team;
+    ParseError err = fromJson(R"({"name":"red","members":["a","b"],"wins":3})", team);
+    if (err != PARSE_OK) {
+        fprintf(stderr, "%s\n", parseErrorStr(err));
+        return 1;
+    }
+    team.wins++;
+    Writer teamWriter(os);
+    toJson(team, teamWriter);
+    os.put('\n');
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+#ifndef TJSON_ASYNCFILEWRITESTREAM_H
+#define TJSON_ASYNCFILEWRITESTREAM_H
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#include <hjson/FdWriteStream.h>
+#include <hjson/noncopyable.h>
+
+namespace json
+{
+
+//
+// FdWriteStream with the writing moved to a background thread. There
+// are two buffers: put() fills one while the thread writes the other,
+// and a full buffer is handed over as soon as the thread is done with
+// its previous one. When the disk cannot keep up, put() waits there.
+// That wait is the back-pressure, at most two buffers are ever queued.
+//
+// close() writes what is left, stops the thread, syncs under
+// SYNC_ON_CLOSE and returns the errno of the first failure (0 for
+// none). The descriptor stays open. The destructor closes the stream
+// too but has no way to report an error, so call close() when it matters
+//
+class AsyncFileWriteStream: noncopyable
+{
+public:
+    static constexpr size_t kDefaultBufferSize = 4 * 1024 * 1024;
+
+    explicit AsyncFileWriteStream(int fd, SyncPolicy policy = SYNC_NONE,
+                                  size_t bufferSize = kDefaultBufferSize):
+            fd_(fd),
+            policy_(policy),
+            front_(new char[bufferSize > 0 ? bufferSize : 1]),
+            back_(new char[bufferSize > 0 ? bufferSize : 1]),
+            capacity_(bufferSize > 0 ? bufferSize : 1),
+            thread_([this] { run(); })
+    {}
+
+    ~AsyncFileWriteStream()
+    { close(); }
+
+    void put(char c)
+    {
+        if (size_ == capacity_)
+            handOver();
+        front_[size_++] = c;
+    }
+    void put(const char* str)
+    {
+        put(std::string_view(str));
+    }
+    void put(std::string_view str)
+    {
+        while (str.size() > capacity_ - size_) {
+            size_t head = capacity_ - size_;
+            memcpy(front_.get() + size_, str.data(), head);
+            size_ = capacity_;
+            str.remove_prefix(head);
+            handOver();
+        }
+        memcpy(front_.get() + size_, str.data(), str.size());
+        size_ += str.size();
+    }
+
+    // returns once everything put so far is written
+    bool flush()
+    {
+        handOver();
+        waitIdle();
+        if (policy_ == SYNC_ON_FLUSH)
+            sync();
+        return error() == 0;
+    }
+
+    // the rest of the output is written, later calls return the same
+    int close()
+    {
+        if (thread_.joinable()) {
+            handOver();
+            {
+                std::lock_guard lock(mutex_);
+                stopping_ = true;
+            }
+            work_.notify_one();
+            thread_.join();
+            if (policy_ != SYNC_NONE)
+                sync();
+        }
+        return error();
+    }
+
+    // 0 while every write succeeded
+    int error() const
+    { return error_.load(std::memory_order_acquire); }
+
+private:
+    // waits for the thread to finish the back buffer, then swaps
+    void handOver()
+    {
+        assert(thread_.joinable() && "put() after close()");
+        if (!thread_.joinable()) {
+            size_ = 0;
+            return;
+        }
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+        if (size_ == 0)
+            return;
+        std::swap(front_, back_);
+        pending_ = size_;
+        size_ = 0;
+        lock.unlock();
+        work_.notify_one();
+    }
+
+    void waitIdle()
+    {
+        std::unique_lock lock(mutex_);
+        idle_.wait(lock, [this] { return pending_ == 0; });
+    }
+
+    void run()
+    {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            work_.wait(lock, [this] { return pending_ > 0 || stopping_; });
+            if (pending_ == 0)
+                return;
+            // put() does not touch back_ until pending_ is back to 0
+            iovec iov = { back_.get(), pending_ };
+            lock.unlock();
+            // after a failure the output is dropped
+            if (error() == 0)
+                fail(detail::writeAll(fd_, &iov, 1));
+            lock.lock();
+            pending_ = 0;
+            idle_.notify_one();
+        }
+    }
+
+    void sync()
+    {
+        if (error() == 0)
+            fail(detail::syncFd(fd_));
+    }
+
+    void fail(int err)
+    {
+        int none = 0;
+        if (err != 0)
+            error_.compare_exchange_strong(none, err, std::memory_order_release);
+    }
+
+private:
+    int fd_;
+    SyncPolicy policy_;
+    std::unique_ptr<char[]> front_; // filled by put()
+    std::unique_ptr<char[]> back_;  // written by the thread
+    size_t capacity_;
+    size_t size_ = 0;
+
+    std::mutex mutex_;
+    std::condition_variable work_;
+    std::condition_variable idle_;
+    size_t pending_ = 0; // bytes of back_ to write
+    bool stopping_ = false;
+    std::atomic<int> error_{ 0 };
+
+    // last, it starts running once everything above is constructed
+    std::thread thread_;
+};
+
+}
+
+#endif //TJSON_ASYNCFILEWRITESTREAM_H
@@ -0,0 +1,600 @@
+#ifndef TJSON_BINDING_H
+#define TJSON_BINDING_H
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <hjson/Reader.h>
+#include <hjson/StringReadStream.h>
+
+//
+// declarative struct binding, at namespace scope next to the struct:
+//
+//   struct Person { std::string name; int32_t age; std::vector<Person> kids; };
+//   HJSON_FIELDS(Person, name, age, kids)
+//
+//   Person p;
+//   json::fromJson(text, p);   // Reader events straight into the members
+//   json::toJson(p, writer);   // any handler, e.g. Writer
+//
+// Members can be bool, integers, floating point, std::string, std::vector
+// of a supported type (std::vector<bool> included) and other bound
+// structs, up to 32 per struct. Keys
+// are matched with a perfect hash built at compile time, unknown keys are
+// skipped by the reader without events, null leaves a member untouched
+//
+#define HJSON_FIELDS(Type, ...) \
+    constexpr auto hjsonFields(const Type*) \
+    { return std::make_tuple(HJSON_FOR_EACH(HJSON_FIELD, Type, __VA_ARGS__)); }
+
+#define HJSON_FIELD(Type, member) ::json::detail::makeField(#member, &Type::member)
+
+#define HJSON_EXPAND(x) x
+#define HJSON_FOR_EACH(f, T, ...) \
+    HJSON_EXPAND(HJSON_PICK(__VA_ARGS__, \
+        HJSON_FOR_EACH_32, HJSON_FOR_EACH_31, HJSON_FOR_EACH_30, HJSON_FOR_EACH_29, \
+        HJSON_FOR_EACH_28, HJSON_FOR_EACH_27, HJSON_FOR_EACH_26, HJSON_FOR_EACH_25, \
+        HJSON_FOR_EACH_24, HJSON_FOR_EACH_23, HJSON_FOR_EACH_22, HJSON_FOR_EACH_21, \
+        HJSON_FOR_EACH_20, HJSON_FOR_EACH_19, HJSON_FOR_EACH_18, HJSON_FOR_EACH_17, \
+        HJSON_FOR_EACH_16, HJSON_FOR_EACH_15, HJSON_FOR_EACH_14, HJSON_FOR_EACH_13, \
+        HJSON_FOR_EACH_12, HJSON_FOR_EACH_11, HJSON_FOR_EACH_10, HJSON_FOR_EACH_9, \
+        HJSON_FOR_EACH_8, HJSON_FOR_EACH_7, HJSON_FOR_EACH_6, HJSON_FOR_EACH_5, \
+        HJSON_FOR_EACH_4, HJSON_FOR_EACH_3, HJSON_FOR_EACH_2, HJSON_FOR_EACH_1)(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_1(f, T, a) f(T, a)
+#define HJSON_FOR_EACH_2(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_1(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_3(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_2(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_4(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_3(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_5(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_4(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_6(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_5(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_7(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_6(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_8(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_7(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_9(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_8(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_10(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_9(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_11(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_10(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_12(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_11(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_13(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_12(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_14(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_13(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_15(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_14(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_16(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_15(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_17(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_16(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_18(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_17(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_19(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_18(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_20(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_19(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_21(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_20(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_22(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_21(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_23(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_22(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_24(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_23(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_25(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_24(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_26(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_25(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_27(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_26(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_28(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_27(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_29(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_28(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_30(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_29(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_31(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_30(f, T, __VA_ARGS__))
+#define HJSON_FOR_EACH_32(f, T, a, ...) f(T, a), HJSON_EXPAND(HJSON_FOR_EACH_31(f, T, __VA_ARGS__))
+#define HJSON_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+
+namespace json
+{
+
+namespace detail
+{
+
+template <typename T, typename M>
+struct Field
+{
+    std::string_view name;
+    M T::* member;
+};
+
+template <typename T, typename M>
+constexpr Field<T, M> makeField(const char* name, M T::* member)
+{ return Field<T, M>{ name, member }; }
+
+template <typename T, typename = void>
+struct IsBound: std::false_type {};
+
+template <typename T>
+struct IsBound<T, std::void_t<decltype(hjsonFields(static_cast<const T*>(nullptr)))>>:
+        std::true_type {};
+
+template <typename T>
+struct IsVector: std::false_type {};
+
+template <typename T, typename A>
+struct IsVector<std::vector<T, A>>: std::true_type {};
+
+template <typename T>
+constexpr bool isInteger = std::is_integral_v<T> && !std::is_same_v<T, bool>;
+
+constexpr uint32_t fieldHash(std::string_view key, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ (seed * 0x9E3779B1u);
+    for (char ch: key) {
+        h ^= static_cast<uint8_t>(ch);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+//
+// perfect hash over the field names: slots[hash & mask] is the field
+// index + 1, found by trying seeds at compile time
+//
+template <size_t N>
+struct FieldTable
+{
+    static constexpr size_t kSize = [] {
+        size_t size = 4;
+        while (size < 4 * N)
+            size *= 2;
+        return size;
+    }();
+
+    constexpr explicit FieldTable(const std::array<std::string_view, N>& names_):
+            names(names_), seed(0), found(false), slots()
+    {
+        for (uint32_t s = 0; s < 4096 && !found; s++) {
+            slots = {};
+            found = true;
+            for (size_t i = 0; i < N && found; i++) {
+                auto& slot = slots[fieldHash(names[i], s) & (kSize - 1)];
+                if (slot != 0)
+                    found = false;
+                slot = static_cast<uint8_t>(i + 1);
+            }
+            seed = s;
+        }
+    }
+
+    // field index, N when unknown
+    size_t find(std::string_view key) const
+    {
+        if (found) {
+            size_t slot = slots[fieldHash(key, seed) & (kSize - 1)];
+            return slot != 0 && names[slot - 1] == key ? slot - 1 : N;
+        }
+        for (size_t i = 0; i < N; i++) {
+            if (names[i] == key)
+                return i;
+        }
+        return N;
+    }
+
+    std::array<std::string_view, N> names;
+    uint32_t seed;
+    bool found;
+    std::array<uint8_t, kSize> slots;
+};
+
+//
+// type-erased destination of the next value: event functions for one
+// member type plus a pointer to the member
+//
+struct SinkOps;
+
+struct Sink
+{
+    void* target;
+    const SinkOps* ops; // nullptr: value is ignored
+};
+
+struct SinkOps
+{
+    bool (*boolean)(void*, bool);
+    bool (*integer)(void*, int64_t);
+    bool (*number)(void*, double);
+    bool (*string)(void*, std::string_view);
+    bool (*startObject)(void*);
+    Sink (*field)(void*, std::string_view);
+    bool (*startArray)(void*);
+    Sink (*element)(void*);
+};
+
+template <typename T>
+struct Binding
+{
+    static constexpr auto fields = hjsonFields(static_cast<const T*>(nullptr));
+    static constexpr size_t kCount = std::tuple_size_v<decltype(fields)>;
+
+    template <size_t... I>
+    static constexpr std::array<std::string_view, kCount> names(std::index_sequence<I...>)
+    { return { std::get<I>(fields).name... }; }
+
+    static constexpr FieldTable<kCount> table{ names(std::make_index_sequence<kCount>()) };
+};
+
+// the element just appended to a std::vector<bool>, which has no bool&
+// to hand out
+struct BoolElementSink
+{
+    static bool boolean(void* target, bool b)
+    {
+        static_cast<std::vector<bool>*>(target)->back() = b;
+        return true;
+    }
+    static bool integer(void*, int64_t) { return false; }
+    static bool number(void*, double) { return false; }
+    static bool string(void*, std::string_view) { return false; }
+    static bool startObject(void*) { return false; }
+    static Sink field(void*, std::string_view) { return Sink{ nullptr, nullptr }; }
+    static bool startArray(void*) { return false; }
+    static Sink element(void*) { return Sink{ nullptr, nullptr }; }
+
+    static constexpr SinkOps ops = {
+            &boolean, &integer, &number, &string,
+            &startObject, &field, &startArray, &element
+    };
+};
+
+template <typename T>
+struct SinkFor
+{
+    static bool boolean(void* target, bool b)
+    {
+        if constexpr (std::is_same_v<T, bool>) {
+            *static_cast<T*>(target) = b;
+            return true;
+        }
+        else
+            return false;
+    }
+
+    static bool integer(void* target, int64_t i64)
+    {
+        if constexpr (isInteger<T>) {
+            if constexpr (std::is_unsigned_v<T>) {
+                if (i64 < 0 || static_cast<uint64_t>(i64) > std::numeric_limits<T>::max())
+                    return false;
+            }
+            else {
+                if (i64 < std::numeric_limits<T>::min() || i64 > std::numeric_limits<T>::max())
+                    return false;
+            }
+            *static_cast<T*>(target) = static_cast<T>(i64);
+            return true;
+        }
+        else if constexpr (std::is_floating_point_v<T>) {
+            *static_cast<T*>(target) = static_cast<T>(i64);
+            return true;
+        }
+        else
+            return false;
+    }
+
+    static bool number(void* target, double d)
+    {
+        if constexpr (std::is_floating_point_v<T>) {
+            *static_cast<T*>(target) = static_cast<T>(d);
+            return true;
+        }
+        else
+            return false;
+    }
+
+    static bool string(void* target, std::string_view s)
+    {
+        if constexpr (std::is_same_v<T, std::string>) {
+            static_cast<T*>(target)->assign(s.data(), s.size());
+            return true;
+        }
+        else
+            return false;
+    }
+
+    static bool startObject(void*)
+    { return IsBound<T>::value; }
+
+    static Sink field(void* target, std::string_view key)
+    {
+        if constexpr (IsBound<T>::value) {
+            constexpr size_t count = Binding<T>::kCount;
+            size_t i = Binding<T>::table.find(key);
+            if (i == count)
+                return Sink{ nullptr, nullptr };
+            return fieldSink(static_cast<T*>(target), i, std::make_index_sequence<count>());
+        }
+        else
+            return Sink{ nullptr, nullptr };
+    }
+
+    static bool startArray(void* target)
+    {
+        if constexpr (IsVector<T>::value) {
+            static_cast<T*>(target)->clear();
+            return true;
+        }
+        else
+            return false;
+    }
+
+    static Sink element(void* target)
+    {
+        if constexpr (std::is_same_v<T, std::vector<bool>>) {
+            auto& vec = *static_cast<T*>(target);
+            vec.emplace_back();
+            return Sink{ &vec, &BoolElementSink::ops };
+        }
+        else if constexpr (IsVector<T>::value) {
+            auto& vec = *static_cast<T*>(target);
+            vec.emplace_back();
+            return Sink{ &vec.back(), &SinkFor<typename T::value_type>::ops };
+        }
+        else
+            return Sink{ nullptr, nullptr };
+    }
+
+    template <size_t... I>
+    static Sink fieldSink(T* object, size_t i, std::index_sequence<I...>)
+    {
+        // jump table over the fields
+        using Get = Sink (*)(T*);
+        static constexpr Get table[] = { &fieldSinkAt<I>... };
+        return table[i](object);
+    }
+
+    template <size_t I>
+    static Sink fieldSinkAt(T* object)
+    {
+        auto& member = object->*(std::get<I>(Binding<T>::fields).member);
+        return Sink{ &member, &SinkFor<std::remove_reference_t<decltype(member)>>::ops };
+    }
+
+    static constexpr SinkOps ops = {
+            &boolean, &integer, &number, &string,
+            &startObject, &field, &startArray, &element
+    };
+};
+
+}
+
+//
+// Reader handler writing into bound structs, the stack holds the struct
+// or vector every open object or array is written to
+//
+class BindingHandler: noncopyable
+{
+public:
+    explicit BindingHandler(detail::Sink root):
+            next_(root)
+    {}
+
+    // a value did not fit the type of its member
+    bool mismatch() const
+    { return mismatch_; }
+
+public: // handler
+    bool Null()
+    {
+        value();
+        return true;
+    }
+    bool Bool(bool b)
+    {
+        auto sink = value();
+        return sink.ops == nullptr || check(sink.ops->boolean(sink.target, b));
+    }
+    bool Int32(int32_t i32)
+    { return Int64(i32); }
+    bool Int64(int64_t i64)
+    {
+        auto sink = value();
+        return sink.ops == nullptr || check(sink.ops->integer(sink.target, i64));
+    }
+    bool Double(double d)
+    {
+        auto sink = value();
+        return sink.ops == nullptr || check(sink.ops->number(sink.target, d));
+    }
+    bool String(std::string_view s)
+    {
+        auto sink = value();
+        return sink.ops == nullptr || check(sink.ops->string(sink.target, s));
+    }
+    bool Key(std::string_view s)
+    {
+        auto& top = stack_.back();
+        next_ = top.ops == nullptr ? detail::Sink{ nullptr, nullptr } : top.ops->field(top.target, s);
+        return true;
+    }
+    bool StartObject()
+    {
+        auto sink = value();
+        if (sink.ops != nullptr && !check(sink.ops->startObject(sink.target)))
+            return false;
+        stack_.push_back(sink);
+        isArray_.push_back(false);
+        return true;
+    }
+    bool EndObject()
+    {
+        stack_.pop_back();
+        isArray_.pop_back();
+        return true;
+    }
+    bool StartArray()
+    {
+        auto sink = value();
+        if (sink.ops != nullptr && !check(sink.ops->startArray(sink.target)))
+            return false;
+        stack_.push_back(sink);
+        isArray_.push_back(true);
+        return true;
+    }
+    bool EndArray()
+    { return EndObject(); }
+
+    // unknown members are skipped by the reader
+    bool skipValue()
+    { return !isArray_.back() && next_.ops == nullptr; }
+
+private:
+    // destination of the value that starts now
+    detail::Sink value()
+    {
+        if (stack_.empty() || !isArray_.back())
+            return next_;
+        auto& top = stack_.back();
+        return top.ops == nullptr ? top : top.ops->element(top.target);
+    }
+
+    bool check(bool ok)
+    {
+        mismatch_ = !ok;
+        return ok;
+    }
+
+private:
+    detail::Sink next_;
+    std::vector<detail::Sink> stack_;
+    std::vector<bool> isArray_;
+    bool mismatch_ = false;
+};
+
+// PARSE_TYPE_MISMATCH when a value does not fit its member
+template <typename ReadStream, typename T>
+inline ParseError fromJsonStream(ReadStream& is, T& value)
+{
+    BindingHandler handler(detail::Sink{ &value, &detail::SinkFor<T>::ops });
+    ParseError err = Reader::parse(is, handler);
+    return err == PARSE_USER_STOPPED && handler.mismatch() ? PARSE_TYPE_MISMATCH : err;
+}
+
+template <typename T>
+inline ParseError fromJson(std::string_view json, T& value)
+{
+    StringReadStream is(json);
+    return fromJsonStream(is, value);
+}
+
+namespace detail
+{
+
+template <typename Handler, typename = void>
+struct HasEscapedKey: std::false_type {};
+
+template <typename Handler>
+struct HasEscapedKey<Handler, std::void_t<decltype(std::declval<Handler&>().EscapedKey(std::string_view()))>>:
+        std::true_type {};
+
+//
+// "\"name\"" for every field: names are identifiers, quoting is all the
+// escaping they need
+//
+template <typename T>
+struct QuotedNames
+{
+    static constexpr size_t kCount = Binding<T>::kCount;
+    static constexpr size_t kBytes = [] {
+        size_t n = 0;
+        for (auto name: Binding<T>::table.names)
+            n += name.size() + 2;
+        return n;
+    }();
+
+    constexpr QuotedNames(): data(), offsets()
+    {
+        size_t pos = 0;
+        for (size_t i = 0; i < kCount; i++) {
+            offsets[i] = pos;
+            data[pos++] = '"';
+            for (char ch: Binding<T>::table.names[i])
+                data[pos++] = ch;
+            data[pos++] = '"';
+        }
+        offsets[kCount] = pos;
+    }
+
+    std::string_view operator[](size_t i) const
+    { return std::string_view(data.data() + offsets[i], offsets[i + 1] - offsets[i]); }
+
+    std::array<char, kBytes> data;
+    std::array<size_t, kCount + 1> offsets;
+};
+
+template <typename T>
+constexpr QuotedNames<T> quotedNames{};
+
+}
+
+//
+// writes a bound struct (or any supported member type) to a handler.
+// Unsigned integers past INT64_MAX and floats go out as number text to
+// handlers taking it (Writer), as doubles to the others
+//
+template <typename T, typename Handler>
+inline bool toJson(const T& value, Handler& handler)
+{
+    if constexpr (std::is_same_v<T, bool>)
+        return handler.Bool(value);
+    else if constexpr (detail::isInteger<T>) {
+        if constexpr (sizeof(T) < sizeof(int32_t) ||
+                      (sizeof(T) == sizeof(int32_t) && std::is_signed_v<T>))
+            return handler.Int32(static_cast<int32_t>(value));
+        else if constexpr (sizeof(T) == sizeof(int64_t) && std::is_unsigned_v<T>) {
+            if (value <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()))
+                return handler.Int64(static_cast<int64_t>(value));
+            if constexpr (detail::HasRawNumber<Handler>::value) {
+                char buf[24];
+                auto result = std::to_chars(buf, buf + sizeof(buf), value);
+                return handler.RawNumber(std::string_view(buf, static_cast<size_t>(result.ptr - buf)));
+            }
+            else
+                return handler.Double(static_cast<double>(value));
+        }
+        else
+            return handler.Int64(static_cast<int64_t>(value));
+    }
+    else if constexpr (std::is_same_v<T, float> && detail::HasRawNumber<Handler>::value) {
+        if (!std::isfinite(value))
+            return handler.Double(static_cast<double>(value));
+        char buf[32];
+        return handler.RawNumber(std::string_view(buf, detail::ftoa(value, buf)));
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+        return handler.Double(static_cast<double>(value));
+    else if constexpr (std::is_same_v<T, std::string>)
+        return handler.String(value);
+    else if constexpr (detail::IsVector<T>::value) {
+        if (!handler.StartArray())
+            return false;
+        // const auto&: std::vector<bool> hands out plain bools
+        for (const auto& element: value) {
+            if (!toJson(element, handler))
+                return false;
+        }
+        return handler.EndArray();
+    }
+    else {
+        static_assert(detail::IsBound<T>::value, "type has no HJSON_FIELDS");
+        if (!handler.StartObject())
+            return false;
+        bool ok = true;
+        size_t i = 0;
+        std::apply([&](const auto&... field) {
+            auto member = [&](const auto& f) {
+                if constexpr (detail::HasEscapedKey<Handler>::value)
+                    ok = ok && handler.EscapedKey(detail::quotedNames<T>[i]);
+                else
+                    ok = ok && handler.Key(f.name);
+                ok = ok && toJson(value.*(f.member), handler);
+                i++;
+            };
+            (member(field), ...);
+        }, detail::Binding<T>::fields);
+        return ok && handler.EndObject();
+    }
+}
+
+}
+
+#endif //TJSON_BINDING_H
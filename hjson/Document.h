@@ -1,6 +1,9 @@
 #ifndef TJSON_DOCUMENT_H
 #define TJSON_DOCUMENT_H
 
+#include <array>
+#include <unordered_map>
+
 #include <hjson/Value.h>
 #include <hjson/Reader.h>
 #include <hjson/StringReadStream.h>
@@ -10,9 +13,33 @@ namespace json
 {
 
 
+enum DocumentFlag {
+    FLAG_NONE = 0,
+    // count the elements of every array and object in a pre-pass over the
+    // input and reserve them exactly, only for parse() from memory
+    FLAG_RESERVE_EXACT = 1 << 0,
+    // store every homogeneous numeric array packed, see Value::pack()
+    FLAG_PACK_ARRAYS = 1 << 1,
+    // with FLAG_PACK_ARRAYS, doubles as floats (lossy)
+    FLAG_PACK_FLOAT = 1 << 2,
+    // keep doubles as their source text, converted on the first
+    // getDouble() and written back verbatim (Value::getRawNumber())
+    FLAG_LAZY_NUMBERS = 1 << 3,
+};
+
 class Document: public Value
 {
 public:
+    explicit Document(unsigned flags = FLAG_NONE):
+            flags_(flags)
+    {}
+
+    unsigned getFlags() const
+    { return flags_; }
+
+    void setFlags(unsigned flags)
+    { flags_ = flags; }
+
     ParseError parse(const char* json, size_t len)
     {
         return parse(std::string_view(json, len));
@@ -20,14 +47,80 @@ public:
 
     ParseError parse(std::string_view json)
     {
+        if (flags_ & FLAG_RESERVE_EXACT)
+            Reader::countElements(json, counts_, open_);
         StringReadStream is(json);
-        return parseStream(is);
+        ParseError err = parseStream(is);
+        counts_.clear();
+        return err;
     }
 
     template <typename ReadStream>
     ParseError parseStream(ReadStream& is)
     {
-        return Reader::parse(is, *this);
+        if (seeValue_)
+            clear();
+        nextCount_ = 0;
+        return Reader::parse(is, *this, buffer_);
+    }
+
+    //
+    // drop the content but keep the buffers: uniquely owned nodes go to a
+    // free list and are reused by the next parse, so a long-lived Document
+    // parsing similar input stops allocating
+    //
+    void clear()
+    {
+        // interned keys first, the ones only they hold can then be reused
+        for (auto& keys: layouts_)
+            keys.clear();
+        recycle(*this);
+        recycle(key_);
+        // no lazy number left in the chunk, start it over
+        if (pool_.numbers != nullptr && pool_.numbers->refCount == 1)
+            pool_.numbersUsed = 0;
+        stack_.clear();
+        seeValue_ = false;
+    }
+
+    // memory of the parsed tree, plus the free lists kept for reuse
+    // (counted in totalBytes only)
+    MemoryStats stats() const
+    {
+        MemoryStats stats;
+        std::unordered_set<const void*> visited;
+        collectStats(stats, 0, visited);
+        stats.totalBytes += pool_.bytes();
+        return stats;
+    }
+
+    //
+    // hash-consing: equal strings and subtrees are merged into one shared
+    // node, returns the number of values that now share a node. Only
+    // subtrees that are written the same are merged (objects with their
+    // members in the same order, -0.0 apart from 0.0, lazy numbers with
+    // the same text), so the output does not change. Cheap to call on a
+    // long-lived document, shared subtrees are not walked again
+    //
+    size_t deduplicate()
+    {
+        std::unordered_multimap<size_t, Value*> seen;
+        size_t merged = deduplicate(*this, seen);
+        dropUniqueHashes(*this);
+        return merged;
+    }
+
+    // drop the content and release every buffer
+    void reset()
+    {
+        clear();
+        pool_.release();
+        std::vector<Level>().swap(stack_);
+        std::string().swap(buffer_);
+        std::vector<uint32_t>().swap(counts_);
+        std::vector<uint32_t>().swap(open_);
+        for (auto& keys: layouts_)
+            std::vector<Value>().swap(keys);
     }
 
 public: // handler
@@ -56,32 +149,64 @@ public: // handler
         addValue(Value(d));
         return true;
     }
+    // asked by the reader, doubles then come as RawNumber()
+    bool rawNumbers() const
+    { return flags_ & FLAG_LAZY_NUMBERS; }
+    bool RawNumber(std::string_view text)
+    {
+        if (!(flags_ & FLAG_LAZY_NUMBERS) || text.size() > kMaxRawNumber) {
+            std::string copy(text);
+            return Double(strtod(copy.c_str(), nullptr));
+        }
+        addValue(newRawNumber(text));
+        return true;
+    }
     bool String(std::string_view s)
     {
-        addValue(Value(s));
+        addValue(newString(s));
         return true;
     }
     bool StartObject()
     {
-        auto value = addValue(Value(TYPE_OBJECT));
+        auto value = addValue(newObject());
+        if (nextCount_ < counts_.size())
+            value->o_->data.reserve(counts_[nextCount_++]);
         stack_.emplace_back(value);
         return true;
     }
     bool Key(std::string_view s)
     {
-        addValue(Value(s));
+        assert(!stack_.empty());
+        auto& top = stack_.back();
+        size_t pos = static_cast<size_t>(top.valueCount / 2);
+        if (pos == 0)
+            top.layout = layoutSlot(s);
+
+        // same keys as a recent object so far, share its key string
+        if (top.layout != kNoLayout) {
+            auto& keys = layouts_[top.layout];
+            if (pos < keys.size() && keys[pos].getStringView() == s) {
+                addValue(Value(keys[pos]));
+                return true;
+            }
+            top.layout = kNoLayout;
+        }
+        addValue(newString(s));
         return true;
     }
     bool EndObject()
     {
         assert(!stack_.empty());
         assert(stack_.back().type() == TYPE_OBJECT);
+        rememberLayout(stack_.back());
         stack_.pop_back();
         return true;
     }
     bool StartArray()
     {
-        auto value = addValue(Value(TYPE_ARRAY));
+        auto value = addValue(newArray());
+        if (nextCount_ < counts_.size())
+            value->a_->data.reserve(counts_[nextCount_++]);
         stack_.emplace_back(value);
         return true;
     }
@@ -89,6 +214,8 @@ public: // handler
     {
         assert(!stack_.empty());
         assert(stack_.back().type() == TYPE_ARRAY);
+        if (flags_ & FLAG_PACK_ARRAYS)
+            packArray(*stack_.back().value);
         stack_.pop_back();
         return true;
     }
@@ -104,8 +231,10 @@ private:
             assert(type_ == TYPE_NULL);
             seeValue_ = true;
             type_ = value.type_;
+            aux_ = value.aux_;
             a_ = value.a_;
             value.type_ = TYPE_NULL;
+            value.aux_ = 0;
             value.a_ = nullptr;
             return this;
         }
@@ -134,11 +263,214 @@ private:
         }
     }
 
+private:
+    struct Level;
+
+    Value newString(std::string_view s)
+    {
+        Value value;
+        value.type_ = TYPE_STRING;
+        value.s_ = pool_.strings.empty() ? new StringWithRefCount() : pool_.pop(pool_.strings);
+        value.s_->data.assign(s.begin(), s.end());
+        return value;
+    }
+
+    // the text goes to the current chunk, see Value::rawEntry()
+    Value newRawNumber(std::string_view text)
+    {
+        size_t size = (kRawText + text.size() + 1 + 7) & ~size_t(7);
+        auto& chunk = pool_.numbers;
+        if (chunk == nullptr || pool_.numbersUsed + size > kChunkSize) {
+            pool_.releaseNumbers();
+            chunk = new ChunkWithRefCount(kChunkSize);
+            pool_.numbersUsed = 0;
+        }
+        char* entry = chunk->data.data() + pool_.numbersUsed;
+        new (entry) std::atomic<uint64_t>(0);
+        new (entry + kRawConverted) std::atomic<uint8_t>(0);
+        entry[kRawLength] = static_cast<char>(text.size());
+        memcpy(entry + kRawText, text.data(), text.size());
+        entry[kRawText + text.size()] = '\0';
+
+        Value value;
+        value.type_ = TYPE_DOUBLE;
+        value.n_ = chunk;
+        value.aux_ = static_cast<uint32_t>(pool_.numbersUsed + 1);
+        chunk->incrAndGet();
+        pool_.numbersUsed += size;
+        return value;
+    }
+
+    Value newArray()
+    {
+        Value value;
+        value.type_ = TYPE_ARRAY;
+        value.a_ = pool_.arrays.empty() ? new ArrayWithRefCount() : pool_.pop(pool_.arrays);
+        return value;
+    }
+
+    Value newObject()
+    {
+        Value value;
+        value.type_ = TYPE_OBJECT;
+        value.o_ = pool_.objects.empty() ? new ObjectWithRefCount() : pool_.pop(pool_.objects);
+        return value;
+    }
+
+    // the node holding the Values goes back to the free list
+    void packArray(Value& value)
+    {
+        auto packed = ArrayWithRefCount::newPacked(value.a_->data, flags_ & FLAG_PACK_FLOAT);
+        if (packed == nullptr)
+            return;
+        value.a_->data.clear();
+        pool_.arrays.push_back(value.a_);
+        value.a_ = packed;
+    }
+
+    //
+    // move the uniquely owned nodes of a tree to the free lists, shared
+    // nodes are just released. Children go first and in reverse, so the
+    // next parse of a similar document gets every node back in the same
+    // position, with enough capacity
+    //
+    void recycle(Value& value)
+    {
+        switch (value.type_) {
+            case TYPE_STRING:
+                if (value.s_->refCount == 1) {
+                    value.s_->hash.store(0, std::memory_order_relaxed);
+                    pool_.strings.push_back(value.s_);
+                    value.type_ = TYPE_NULL;
+                }
+                break;
+            case TYPE_ARRAY:
+                if (value.a_->refCount == 1) {
+                    auto& data = value.a_->data;
+                    for (auto it = data.rbegin(); it != data.rend(); ++it)
+                        recycle(*it);
+                    data.clear();
+                    value.a_->hash.store(0, std::memory_order_relaxed);
+                    if (value.a_->packedType == PACKED_NONE)
+                        pool_.arrays.push_back(value.a_);
+                    else {
+                        // sized for its numbers, not worth keeping
+                        value.a_->decrAndGet();
+                        delete value.a_;
+                    }
+                    value.type_ = TYPE_NULL;
+                }
+                break;
+            case TYPE_OBJECT:
+                if (value.o_->refCount == 1) {
+                    auto& data = value.o_->data;
+                    for (auto it = data.rbegin(); it != data.rend(); ++it) {
+                        recycle(it->value);
+                        recycle(it->key);
+                    }
+                    data.clear();
+                    value.o_->dropIndex();
+                    value.o_->hash.store(0, std::memory_order_relaxed);
+                    pool_.objects.push_back(value.o_);
+                    value.type_ = TYPE_NULL;
+                }
+                break;
+            default:
+                break;
+        }
+        value.setNull();
+    }
+
+    static size_t deduplicate(Value& value, std::unordered_multimap<size_t, Value*>& seen)
+    {
+        if (value.type_ < TYPE_STRING)
+            return 0;
+
+        size_t h = value.computeHash(true);
+        auto range = seen.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            Value& canonical = *it->second;
+            if (canonical.equals(value, Value::EQUAL_EXACT)) {
+                if (canonical.sameStorage(value))
+                    return 0;
+                value = canonical;
+                return 1;
+            }
+        }
+
+        // first of its kind, merge inside it. Nodes that are already
+        // shared are left alone, other owners may be reading them
+        size_t merged = 0;
+        if (value.type_ == TYPE_ARRAY && value.a_->refCount == 1) {
+            for (auto& element: value.a_->data)
+                merged += deduplicate(element, seen);
+        }
+        else if (value.type_ == TYPE_OBJECT && value.o_->refCount == 1) {
+            for (auto& member: value.o_->data) {
+                merged += deduplicate(member.key, seen);
+                merged += deduplicate(member.value, seen);
+            }
+        }
+        seen.emplace(h, &value);
+        return merged;
+    }
+
+    // the hashes deduplicate() cached on nodes that are still not shared
+    static void dropUniqueHashes(Value& value)
+    {
+        switch (value.type_) {
+            case TYPE_STRING:
+                if (value.s_->refCount == 1)
+                    value.s_->hash.store(0, std::memory_order_relaxed);
+                break;
+            case TYPE_ARRAY:
+                if (value.a_->refCount == 1) {
+                    value.a_->hash.store(0, std::memory_order_relaxed);
+                    for (auto& element: value.a_->data)
+                        dropUniqueHashes(element);
+                }
+                break;
+            case TYPE_OBJECT:
+                if (value.o_->refCount == 1) {
+                    value.o_->hash.store(0, std::memory_order_relaxed);
+                    for (auto& member: value.o_->data) {
+                        dropUniqueHashes(member.key);
+                        dropUniqueHashes(member.value);
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    size_t layoutSlot(std::string_view firstKey) const
+    {
+        size_t h = std::hash<std::string_view>()(firstKey) + stack_.size() * 0x9E3779B9;
+        return h % kLayoutCacheSize;
+    }
+
+    // the keys of an object that did not match its slot completely
+    // replace them, the next objects like it share its key strings
+    void rememberLayout(const Level& level)
+    {
+        auto& members = level.value->o_->data;
+        size_t size = members.size();
+        if (level.layout != kNoLayout && layouts_[level.layout].size() == size)
+            return;
+        if (size > 0 && size <= kMaxLayoutKeys) {
+            auto& keys = layouts_[layoutSlot(members[0].key.getStringView())];
+            keys.clear();
+            for (auto& member: members)
+                keys.push_back(member.key);
+        }
+    }
+
 private:
     struct Level
     {
         explicit Level(Value* value_):
-                value(value_), valueCount(0)
+                value(value_), valueCount(0), layout(kNoLayout)
         {}
 
         ValueType type() const
@@ -157,12 +489,95 @@ private:
 
         Value* value;
         int valueCount;
+        // slot of the recent object whose keys this object matched so far
+        size_t layout;
+    };
+
+    // free lists of nodes with their capacity, a cache that is not copied
+    struct Pool
+    {
+        Pool() = default;
+        Pool(const Pool&) {}
+        Pool& operator=(const Pool&) { return *this; }
+        ~Pool() { release(); }
+
+        template <typename T>
+        static T* pop(std::vector<T*>& list)
+        {
+            T* node = list.back();
+            list.pop_back();
+            return node;
+        }
+
+        template <typename T>
+        static void release(std::vector<T*>& list)
+        {
+            for (auto node: list) {
+                node->decrAndGet();
+                delete node;
+            }
+            std::vector<T*>().swap(list);
+        }
+
+        void releaseNumbers()
+        {
+            if (numbers != nullptr && numbers->decrAndGet() == 0)
+                delete numbers;
+            numbers = nullptr;
+        }
+
+        void release()
+        {
+            release(strings);
+            release(arrays);
+            release(objects);
+            releaseNumbers();
+        }
+
+        size_t bytes() const
+        {
+            size_t n = (strings.capacity() + arrays.capacity() + objects.capacity()) * sizeof(void*);
+            for (auto node: strings)
+                n += sizeof(*node) + node->data.capacity();
+            for (auto node: arrays)
+                n += sizeof(*node) + node->data.capacity() * sizeof(Value);
+            for (auto node: objects)
+                n += sizeof(*node) + node->data.capacity() * sizeof(Member) + node->indexBytes();
+            // a chunk still in use is counted with its numbers
+            if (numbers != nullptr && numbers->refCount == 1)
+                n += sizeof(*numbers) + numbers->data.capacity();
+            return n;
+        }
+
+        std::vector<StringWithRefCount*> strings;
+        std::vector<ArrayWithRefCount*>  arrays;
+        std::vector<ObjectWithRefCount*> objects;
+        // chunk receiving lazy numbers, and its used bytes
+        ChunkWithRefCount* numbers = nullptr;
+        size_t numbersUsed = 0;
     };
 
 private:
+    // lazy number chunks, longer numbers are converted right away
+    static constexpr size_t kChunkSize = 64 * 1024;
+    static constexpr size_t kMaxRawNumber = 255;
+    // larger objects are treated as maps rather than records
+    static constexpr size_t kMaxLayoutKeys = 64;
+    // keys of recently seen objects, slots by depth and first key
+    static constexpr size_t kLayoutCacheSize = 256;
+    static constexpr size_t kNoLayout = SIZE_MAX;
+
     std::vector<Level> stack_;
     Value key_;
     bool seeValue_ = false;
+    std::array<std::vector<Value>, kLayoutCacheSize> layouts_;
+    std::string buffer_;
+    Pool pool_;
+    unsigned flags_;
+    // element counts from the FLAG_RESERVE_EXACT pre-pass
+    std::vector<uint32_t> counts_;
+    std::vector<uint32_t> open_;
+    size_t nextCount_ = 0;
 };
 
 
@@ -22,7 +22,9 @@ namespace json
   XX(MISS_KEY, "miss key") \
   XX(MISS_COLON, "miss colon") \
   XX(MISS_COMMA_OR_CURLY_BRACKET, "miss comma or curly bracket") \
-  XX(USER_STOPPED, "user stopped parse")
+  XX(USER_STOPPED, "user stopped parse") \
+  XX(TYPE_MISMATCH, "value does not match the bound type") \
+  XX(DOCUMENT_TOO_LARGE, "document too large")
 
 enum ParseError {
 #define GEN_ERRNO(e, s) PARSE_##e,
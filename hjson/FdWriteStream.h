@@ -0,0 +1,182 @@
+#ifndef TJSON_FDWRITESTREAM_H
+#define TJSON_FDWRITESTREAM_H
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <hjson/noncopyable.h>
+
+namespace json
+{
+
+namespace detail
+{
+
+// all of iov to fd, retrying short writes and EINTR. 0 or the errno
+inline int writeAll(int fd, iovec* iov, int count)
+{
+    while (count > 0) {
+        ssize_t n = count == 1 ?
+                    ::write(fd, iov->iov_base, iov->iov_len) :
+                    ::writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno;
+        }
+        auto done = static_cast<size_t>(n);
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+// 0 or the errno, pipes and terminals cannot be synced and lose nothing
+inline int syncFd(int fd)
+{
+#if defined(__linux__)
+    int ret = ::fdatasync(fd);
+#else
+    int ret = ::fsync(fd);
+#endif
+    if (ret != 0 && errno != EINVAL && errno != EROFS)
+        return errno;
+    return 0;
+}
+
+}
+
+enum SyncPolicy
+{
+    SYNC_NONE,      // leave durability to the kernel
+    SYNC_ON_FLUSH,  // fdatasync() after every flush()
+    SYNC_ON_CLOSE,  // fdatasync() once, when the stream is done
+};
+
+//
+// Write stream on a raw file descriptor, no stdio underneath. Fragments
+// collect in a buffer of a few megabytes that goes out with one write()
+// when full; a fragment that is larger than the whole buffer goes out
+// together with the pending bytes in one writev(). The descriptor is not
+// closed, the destructor only flushes.
+//
+// The first failing call stops all further output, error() keeps its errno
+//
+class FdWriteStream: noncopyable
+{
+public:
+    static constexpr size_t kDefaultBufferSize = 4 * 1024 * 1024;
+
+    explicit FdWriteStream(int fd, SyncPolicy policy = SYNC_NONE,
+                           size_t bufferSize = kDefaultBufferSize):
+            fd_(fd),
+            policy_(policy),
+            buffer_(new char[bufferSize > 0 ? bufferSize : 1]),
+            capacity_(bufferSize > 0 ? bufferSize : 1)
+    {}
+
+    ~FdWriteStream()
+    {
+        drain();
+        if (policy_ != SYNC_NONE)
+            sync();
+    }
+
+    void put(char c)
+    {
+        if (size_ == capacity_)
+            drain();
+        buffer_[size_++] = c;
+    }
+    void put(const char* str)
+    {
+        put(std::string_view(str));
+    }
+    void put(std::string_view str)
+    {
+        if (str.size() <= capacity_ - size_) {
+            memcpy(buffer_.get() + size_, str.data(), str.size());
+            size_ += str.size();
+        }
+        else putSlow(str);
+    }
+
+    bool flush()
+    {
+        drain();
+        if (policy_ == SYNC_ON_FLUSH)
+            sync();
+        return error_ == 0;
+    }
+
+    // 0 while every write succeeded
+    int error() const
+    { return error_; }
+
+private:
+    void drain()
+    {
+        if (size_ > 0) {
+            iovec iov = { buffer_.get(), size_ };
+            writeAll(&iov, 1);
+            size_ = 0;
+        }
+    }
+
+    void putSlow(std::string_view str)
+    {
+        if (str.size() < capacity_) {
+            // top the buffer up, so writes stay buffer sized
+            size_t head = capacity_ - size_;
+            memcpy(buffer_.get() + size_, str.data(), head);
+            size_ = capacity_;
+            drain();
+            memcpy(buffer_.get(), str.data() + head, str.size() - head);
+            size_ = str.size() - head;
+        }
+        else {
+            iovec iov[2] = {
+                { buffer_.get(), size_ },
+                { const_cast<char*>(str.data()), str.size() }
+            };
+            writeAll(size_ > 0 ? iov : iov + 1, size_ > 0 ? 2 : 1);
+            size_ = 0;
+        }
+    }
+
+    void writeAll(iovec* iov, int count)
+    {
+        if (error_ == 0)
+            error_ = detail::writeAll(fd_, iov, count);
+    }
+
+    void sync()
+    {
+        if (error_ == 0)
+            error_ = detail::syncFd(fd_);
+    }
+
+private:
+    int fd_;
+    SyncPolicy policy_;
+    std::unique_ptr<char[]> buffer_;
+    size_t capacity_;
+    size_t size_ = 0;
+    int error_ = 0;
+};
+
+}
+
+#endif //TJSON_FDWRITESTREAM_H
@@ -1,35 +1,101 @@
 #ifndef TJSON_FILEWRITESTREAM_H
 #define TJSON_FILEWRITESTREAM_H
 
-#include <string>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string_view>
 
 #include <hjson/noncopyable.h>
 
 namespace json
 {
 
+//
+// Collects the fragments Writer produces in its own buffer and hands them
+// to stdio with one fwrite() per buffer, fragments larger than the buffer
+// go straight through. Output reaches the FILE only when the buffer
+// fills, on flush() or in the destructor. Unlike the unbuffered stream
+// this replaces, it does not interleave with other writes to the same
+// FILE (printf, another stream): call flush() before switching.
+//
+// The FILE must outlive the stream unless everything is flushed: the
+// destructor only touches it when output is still pending, so fclose()
+// after a final flush() is fine with the stream still in scope
+//
 class FileWriteStream: noncopyable
 {
 public:
-    explicit FileWriteStream(FILE* output):
-            output_(output) {}
+    static constexpr size_t kDefaultBufferSize = 64 * 1024;
+
+    explicit FileWriteStream(FILE* output, size_t bufferSize = kDefaultBufferSize):
+            output_(output),
+            buffer_(new char[bufferSize > 0 ? bufferSize : 1]),
+            capacity_(bufferSize > 0 ? bufferSize : 1)
+    {}
+
+    ~FileWriteStream()
+    {
+        if (size_ > 0)
+            flush();
+    }
 
     void put(char c)
     {
-        putc(c, output_);
+        if (size_ == capacity_)
+            drain();
+        buffer_[size_++] = c;
     }
     void put(const char* str)
     {
-        fputs(str, output_);
+        put(std::string_view(str));
     }
     void put(std::string_view str)
     {
-        fprintf(output_, "%.*s", static_cast<int>(str.length()), str.data());
+        if (str.size() <= capacity_ - size_) {
+            memcpy(buffer_.get() + size_, str.data(), str.size());
+            size_ += str.size();
+        }
+        else putSlow(str);
+    }
+
+    // false once any write to the FILE failed
+    bool flush()
+    {
+        drain();
+        if (fflush(output_) != 0)
+            ok_ = false;
+        return ok_;
+    }
+
+    bool ok() const
+    { return ok_; }
+
+private:
+    void drain()
+    {
+        if (size_ > 0 && fwrite(buffer_.get(), 1, size_, output_) != size_)
+            ok_ = false;
+        size_ = 0;
+    }
+
+    void putSlow(std::string_view str)
+    {
+        drain();
+        if (str.size() < capacity_) {
+            memcpy(buffer_.get(), str.data(), str.size());
+            size_ = str.size();
+        }
+        else if (fwrite(str.data(), 1, str.size(), output_) != str.size())
+            ok_ = false;
     }
 
 private:
     FILE* output_;
+    std::unique_ptr<char[]> buffer_;
+    size_t capacity_;
+    size_t size_ = 0;
+    bool ok_ = true;
 };
 
 }
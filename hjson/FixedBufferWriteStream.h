@@ -0,0 +1,98 @@
+#ifndef TJSON_FIXEDBUFFERWRITESTREAM_H
+#define TJSON_FIXEDBUFFERWRITESTREAM_H
+
+#include <cstring>
+#include <string_view>
+
+#include <hjson/noncopyable.h>
+
+namespace json
+{
+
+//
+// Writes into a buffer owned by the caller (a stack array, a slot of a
+// ring) and never allocates. Output that does not fit is counted but not
+// written: overflow() tells, required() is the capacity for a retry.
+//
+// Writer formats numbers and escapes strings in place through claim()
+// whenever the rest of the buffer holds the longest possible text
+//
+class FixedBufferWriteStream: noncopyable
+{
+public:
+    FixedBufferWriteStream(char* buffer, size_t capacity):
+            buffer_(buffer),
+            capacity_(capacity)
+    {}
+
+    template <size_t N>
+    explicit FixedBufferWriteStream(char (&buffer)[N]):
+            FixedBufferWriteStream(buffer, N)
+    {}
+
+    void put(char c)
+    {
+        if (fits(1))
+            buffer_[required_] = c;
+        else
+            stop();
+        required_++;
+    }
+    void put(std::string_view str)
+    {
+        if (fits(str.size()))
+            memcpy(buffer_ + required_, str.data(), str.size());
+        else
+            stop();
+        required_ += str.size();
+    }
+
+    // room for n bytes of unchecked writes, nullptr when not there
+    char* claim(size_t n)
+    {
+        return fits(n) ? buffer_ + required_ : nullptr;
+    }
+    // the first used bytes of the last claim() are output
+    void commit(size_t used)
+    {
+        required_ += used;
+    }
+
+    bool overflow() const
+    { return required_ > capacity_; }
+
+    // bytes of the whole output, fitting or not
+    size_t required() const
+    { return required_; }
+
+    // what fit, a prefix of the output on overflow
+    std::string_view get() const
+    { return std::string_view(buffer_, overflow() ? written_ : required_); }
+
+    void clear()
+    {
+        required_ = 0;
+        written_ = 0;
+    }
+
+private:
+    bool fits(size_t n) const
+    { return required_ <= capacity_ && n <= capacity_ - required_; }
+
+    // the first output that does not fit ends the text
+    void stop()
+    {
+        if (!overflow())
+            written_ = required_;
+    }
+
+private:
+    char* buffer_;
+    size_t capacity_;
+    size_t required_ = 0; // written while it is at most capacity_
+    size_t written_ = 0;  // on overflow
+};
+
+}
+
+#endif //TJSON_FIXEDBUFFERWRITESTREAM_H
@@ -0,0 +1,356 @@
+#ifndef TJSON_FORMAT_H
+#define TJSON_FORMAT_H
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//
+// text formatting shared by Writer and Value::serializedSize()
+//
+
+namespace json
+{
+
+namespace detail
+{
+
+//
+// fast int to string conversion
+// buffer is NOT null terminated!!!
+//
+unsigned itoa(int32_t val, char* buf);
+unsigned itoa(int64_t val, char* buf);
+
+//
+// shortest text that reads back as the same finite double, always marked
+// as a double ("1.0", "1e+21"). buf needs 32 bytes, NOT null terminated
+//
+unsigned dtoa(double val, char* buf);
+
+// first byte in [p, end) that needs escaping in a JSON string, or end
+const char* findEscape(const char* p, const char* end);
+
+// escape letter of a byte, 'u' for \u00XX and 0 for none
+char escapeOf(unsigned char ch);
+
+// s quoted and escaped into out, which has room for 6 * s.size() + 2
+// bytes. Returns the end of the text
+char* escapeTo(std::string_view s, char* out);
+
+//
+// lengths of the texts above without producing them: an integer, a
+// double as Writer::Double() puts it (non-finite included) and a string
+// quoted and escaped
+//
+size_t intSize(int64_t val);
+size_t doubleSize(double val);
+size_t escapedSize(std::string_view s);
+
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+
+inline unsigned countDigits(uint32_t n)
+{
+    const uint32_t powers_of_10[] = {
+            0,
+            10,
+            100,
+            1000,
+            10000,
+            100000,
+            1000000,
+            10000000,
+            100000000,
+            1000000000
+    };
+    //
+    // about magic number:
+    //     http://graphics.stanford.edu/~seander/bithacks.html#IntegerLog10
+    // __builtin_clz is gcc builtin:
+    //     https://en.wikipedia.org/wiki/Bit_Manipulation_Instruction_Sets
+    //     https://gcc.gnu.org/onlinedocs/gcc/Other-Builtins.html
+    //
+    uint32_t t = static_cast<uint32_t>((32 - __builtin_clz(n | 1)) * 1233 >> 12);
+    return t - (n < powers_of_10[t]) + 1;
+}
+
+inline unsigned countDigits(uint64_t n)
+{
+    const uint64_t powers_of_10[] = {
+            0,
+            10,
+            100,
+            1000,
+            10000,
+            100000,
+            1000000,
+            10000000,
+            100000000,
+            1000000000,
+            10000000000,
+            100000000000,
+            1000000000000,
+            10000000000000,
+            100000000000000,
+            1000000000000000,
+            10000000000000000,
+            100000000000000000,
+            1000000000000000000,
+            10000000000000000000U
+    };
+    uint32_t t = (64 - __builtin_clzll(n | 1)) * 1233 >> 12;
+    return t - (n < powers_of_10[t]) + 1;
+}
+
+
+
+template <typename T>
+unsigned itoa_(T val, char* buf)
+{
+    static_assert(std::is_unsigned<T>::value, "must be unsigned integer");
+
+    const char digits[201] =
+            "0001020304050607080910111213141516171819"
+            "2021222324252627282930313233343536373839"
+            "4041424344454647484950515253545556575859"
+            "6061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+    unsigned count = countDigits(val);
+    unsigned next = count - 1;
+
+    while (val >= 100) {
+        unsigned i = (val % 100) * 2;
+        val /= 100;
+        buf[next] = digits[i + 1];
+        buf[next - 1] = digits[i];
+        next -= 2;
+    }
+
+    /* Handle last 1-2 digits. */
+    if (val < 10) {
+        buf[next] = '0' + val;
+    }
+    else {
+        unsigned i = val * 2;
+        buf[next] = digits[i + 1];
+        buf[next - 1] = digits[i];
+    }
+    return count;
+}
+#pragma GCC diagnostic pop
+
+
+}
+
+namespace json::detail
+{
+
+
+inline unsigned itoa(int32_t val, char* buf)
+{
+    auto u = static_cast<uint32_t>(val);
+    if (val < 0) {
+        *buf++ = '-';
+        u = ~u + 1;
+    }
+    return (val < 0) + itoa_(u, buf);
+}
+
+
+inline unsigned itoa(int64_t val, char* buf)
+{
+    auto u = static_cast<uint64_t>(val);
+    if (val < 0) {
+        *buf++ = '-';
+        u = ~u + 1;
+    }
+    return (val < 0) + itoa_(u, buf);
+}
+
+
+inline char escapeOf(unsigned char ch)
+{
+    struct Table
+    {
+        constexpr Table(): escape()
+        {
+            for (unsigned i = 0; i < 0x20; i++)
+                escape[i] = 'u';
+            escape[static_cast<unsigned char>('"')] = '"';
+            escape[static_cast<unsigned char>('\\')] = '\\';
+            escape[static_cast<unsigned char>('\b')] = 'b';
+            escape[static_cast<unsigned char>('\f')] = 'f';
+            escape[static_cast<unsigned char>('\n')] = 'n';
+            escape[static_cast<unsigned char>('\r')] = 'r';
+            escape[static_cast<unsigned char>('\t')] = 't';
+        }
+        char escape[256];
+    };
+    static constexpr Table table;
+    return table.escape[ch];
+}
+
+inline const char* findEscape(const char* p, const char* end)
+{
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // unsigned v <= 0x1F
+        __m128i mask = _mm_cmpeq_epi8(_mm_min_epu8(v, control), v);
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, quote));
+        mask = _mm_or_si128(mask, _mm_cmpeq_epi8(v, backslash));
+        int bits = _mm_movemask_epi8(mask);
+        if (bits != 0)
+            return p + __builtin_ctz(static_cast<unsigned>(bits));
+    }
+#else
+    // 8 bytes at a time, a hit is located by the byte loop below
+    const uint64_t ones = 0x0101010101010101;
+    const uint64_t high = 0x8080808080808080;
+    auto zeroByte = [&](uint64_t x) { return (x - ones) & ~x & high; };
+    for (; end - p >= 8; p += 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        uint64_t hit = zeroByte(w ^ (ones * '"')) | zeroByte(w ^ (ones * '\\')) |
+                       ((w - ones * 0x20) & ~w & high);
+        if (hit != 0)
+            break;
+    }
+#endif
+    for (; p != end; p++) {
+        if (escapeOf(static_cast<unsigned char>(*p)) != 0)
+            return p;
+    }
+    return end;
+}
+
+// "1" -> "1.0", the text of a double must read back as one
+inline unsigned markDouble(char* buf, unsigned n)
+{
+    auto marked = std::find_if(buf, buf + n, [](char ch) {
+        return ch == '.' || ch == 'e' || ch == 'E';
+    });
+    if (marked == buf + n) {
+        buf[n++] = '.';
+        buf[n++] = '0';
+    }
+    return n;
+}
+
+inline unsigned dtoa(double val, char* buf)
+{
+    assert(std::isfinite(val));
+#if defined(__cpp_lib_to_chars)
+    // shortest round trip (Ryu in libstdc++), independent of the locale
+    auto result = std::to_chars(buf, buf + 32, val);
+    assert(result.ec == std::errc());
+    auto n = static_cast<unsigned>(result.ptr - buf);
+#else
+    // fewest significant digits that read back the same
+    int len = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        len = snprintf(buf, 32, "%.*g", precision, val);
+        if (strtod(buf, nullptr) == val)
+            break;
+    }
+    auto n = static_cast<unsigned>(len);
+#endif
+    return markDouble(buf, n);
+}
+
+// dtoa() with the shortest text that reads back as the same float:
+// 0.1f is "0.1", not the "0.10000000149011612" of its double
+inline unsigned ftoa(float val, char* buf)
+{
+    assert(std::isfinite(val));
+#if defined(__cpp_lib_to_chars)
+    auto result = std::to_chars(buf, buf + 32, val);
+    assert(result.ec == std::errc());
+    auto n = static_cast<unsigned>(result.ptr - buf);
+#else
+    int len = 0;
+    for (int precision = 6; precision <= 9; precision++) {
+        len = snprintf(buf, 32, "%.*g", precision, static_cast<double>(val));
+        if (strtof(buf, nullptr) == val)
+            break;
+    }
+    auto n = static_cast<unsigned>(len);
+#endif
+    return markDouble(buf, n);
+}
+
+inline size_t intSize(int64_t val)
+{
+    auto u = static_cast<uint64_t>(val);
+    if (val < 0)
+        u = ~u + 1;
+    return (val < 0) + countDigits(u);
+}
+
+inline size_t doubleSize(double val)
+{
+    if (std::isinf(val))
+        return 8; // Infinity
+    if (std::isnan(val))
+        return 3; // NaN
+    char buf[32];
+    return dtoa(val, buf);
+}
+
+inline char* escapeTo(std::string_view s, char* out)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    *out++ = '"';
+    const char* p = s.data();
+    const char* end = p + s.size();
+    while (true) {
+        const char* q = findEscape(p, end);
+        memcpy(out, p, static_cast<size_t>(q - p));
+        out += q - p;
+        if (q == end)
+            break;
+        auto ch = static_cast<unsigned char>(*q);
+        char escape = escapeOf(ch);
+        *out++ = '\\';
+        *out++ = escape;
+        if (escape == 'u') {
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex[ch >> 4];
+            *out++ = hex[ch & 0xF];
+        }
+        p = q + 1;
+    }
+    *out++ = '"';
+    return out;
+}
+
+inline size_t escapedSize(std::string_view s)
+{
+    size_t size = s.size() + 2;
+    const char* end = s.data() + s.size();
+    for (const char* p = findEscape(s.data(), end); p != end; p = findEscape(p + 1, end))
+        size += escapeOf(static_cast<unsigned char>(*p)) == 'u' ? 5 : 1;
+    return size;
+}
+
+}
+
+#endif //TJSON_FORMAT_H
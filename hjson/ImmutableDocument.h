@@ -0,0 +1,521 @@
+#ifndef TJSON_IMMUTABLEDOCUMENT_H
+#define TJSON_IMMUTABLEDOCUMENT_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <hjson/Value.h>
+#include <hjson/Reader.h>
+#include <hjson/StringReadStream.h>
+
+namespace json
+{
+
+//
+// read-only document stored as one tape of 64-bit words:
+//
+//   null, bool, int32       [tag | payload]
+//   int64, double           [tag] [64-bit payload]
+//   string                  [tag | offset into string buffer]
+//   array, object start     [tag | count << 32 | index of end word]
+//   array, object end       [end tag | index of start word]
+//
+// the tag lives in the top 8 bits, object members are key string
+// words followed by their value. Strings are stored as a 32-bit length
+// and the bytes in a separate buffer. Word indices are 32-bit, parse()
+// fails with PARSE_DOCUMENT_TOO_LARGE past 2^32 - 1 words or for a
+// string of 4 GB or more.
+//
+
+class ImmutableDocument;
+
+class ImmutableValue
+{
+public:
+    class ArrayIterator;
+    class MemberIterator;
+
+    ImmutableValue(const ImmutableDocument* doc, uint32_t index):
+            doc_(doc), index_(index)
+    {}
+
+    ValueType getType() const;
+    size_t getSize() const;
+
+    bool isNull()   const { return getType() == TYPE_NULL; }
+    bool isBool()   const { return getType() == TYPE_BOOL; }
+    bool isInt32()  const { return getType() == TYPE_INT32; }
+    bool isInt64()  const { return getType() == TYPE_INT64 || getType() == TYPE_INT32; }
+    bool isDouble() const { return getType() == TYPE_DOUBLE; }
+    bool isString() const { return getType() == TYPE_STRING; }
+    bool isArray()  const { return getType() == TYPE_ARRAY; }
+    bool isObject() const { return getType() == TYPE_OBJECT; }
+
+    bool getBool() const;
+    int32_t getInt32() const;
+    int64_t getInt64() const;
+    double getDouble() const;
+    std::string_view getStringView() const;
+    std::string getString() const
+    { return std::string(getStringView()); }
+
+    // walks the i elements before it, loop over arrayBegin()/arrayEnd()
+    // rather than over indices
+    ImmutableValue operator[] (size_t i) const;
+    ImmutableValue operator[] (std::string_view key) const;
+
+    ArrayIterator arrayBegin() const;
+    ArrayIterator arrayEnd() const;
+
+    MemberIterator memberBegin() const;
+    MemberIterator memberEnd() const;
+    MemberIterator findMember(std::string_view key) const;
+
+    template <typename Handler>
+    bool writeTo(Handler& handler) const;
+
+private:
+    uint64_t word() const;
+    uint32_t next() const;
+
+    const ImmutableDocument* doc_;
+    uint32_t index_;
+};
+
+struct ImmutableMember
+{
+    ImmutableValue key;
+    ImmutableValue value;
+};
+
+class ImmutableDocument: noncopyable
+{
+public:
+    ParseError parse(const char* json, size_t len)
+    {
+        return parse(std::string_view(json, len));
+    }
+
+    ParseError parse(std::string_view json)
+    {
+        // enough for typical JSON, both grow geometrically otherwise
+        clear();
+        tape_.reserve(json.size() / 4 + 4);
+        strings_.reserve(json.size() / 2 + 16);
+        StringReadStream is(json);
+        return parseStream(is);
+    }
+
+    template <typename ReadStream>
+    ParseError parseStream(ReadStream& is)
+    {
+        clear();
+        ParseError err = Reader::parse(is, *this, buffer_);
+        if (err == PARSE_USER_STOPPED && tooLarge_)
+            err = PARSE_DOCUMENT_TOO_LARGE;
+        if (err != PARSE_OK)
+            clear();
+        return err;
+    }
+
+    // keeps the buffers for the next parse
+    void clear()
+    {
+        tape_.clear();
+        strings_.clear();
+        stack_.clear();
+        tooLarge_ = false;
+    }
+
+    ImmutableValue root() const
+    {
+        assert(!tape_.empty());
+        return ImmutableValue(this, 0);
+    }
+
+public: // handler
+    bool Null()
+    {
+        return put(TYPE_NULL, 0);
+    }
+    bool Bool(bool b)
+    {
+        return put(TYPE_BOOL, b);
+    }
+    bool Int32(int32_t i32)
+    {
+        return put(TYPE_INT32, static_cast<uint32_t>(i32));
+    }
+    bool Int64(int64_t i64)
+    {
+        if (!put(TYPE_INT64, 0, 2))
+            return false;
+        tape_.push_back(static_cast<uint64_t>(i64));
+        return true;
+    }
+    bool Double(double d)
+    {
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        if (!put(TYPE_DOUBLE, 0, 2))
+            return false;
+        tape_.push_back(bits);
+        return true;
+    }
+    bool String(std::string_view s)
+    {
+        if (s.size() > UINT32_MAX)
+            return tooLarge();
+        if (!put(TYPE_STRING, strings_.size()))
+            return false;
+        auto len = static_cast<uint32_t>(s.size());
+        auto lenBytes = reinterpret_cast<const char*>(&len);
+        strings_.insert(strings_.end(), lenBytes, lenBytes + sizeof(len));
+        strings_.insert(strings_.end(), s.begin(), s.end());
+        return true;
+    }
+    bool Key(std::string_view s)
+    {
+        return String(s);
+    }
+    bool StartObject()
+    {
+        return start(TYPE_OBJECT);
+    }
+    bool EndObject()
+    {
+        return end(TAG_END_OBJECT);
+    }
+    bool StartArray()
+    {
+        return start(TYPE_ARRAY);
+    }
+    bool EndArray()
+    {
+        return end(TAG_END_ARRAY);
+    }
+
+private:
+    friend class ImmutableValue;
+
+    static constexpr uint64_t TAG_END_ARRAY  = TYPE_OBJECT + 1;
+    static constexpr uint64_t TAG_END_OBJECT = TYPE_OBJECT + 2;
+    static constexpr uint64_t kPayloadMask = (uint64_t(1) << 56) - 1;
+    static constexpr uint64_t kIndexMask   = UINT32_MAX;
+    static constexpr uint64_t kMaxCount    = (uint64_t(1) << 24) - 1;
+    // every word index fits the 32 bits of ImmutableValue and the tape
+    static constexpr uint64_t kMaxWords    = UINT32_MAX;
+
+    static uint64_t tagOf(uint64_t word)
+    { return word >> 56; }
+
+    // false when the tape has no room for the value's words
+    bool put(uint64_t tag, uint64_t payload, size_t words = 1)
+    {
+        assert(payload <= kPayloadMask);
+        if (tape_.size() + words > kMaxWords)
+            return tooLarge();
+        tape_.push_back(tag << 56 | payload);
+        if (!stack_.empty())
+            stack_.back().count++;
+        return true;
+    }
+
+    bool tooLarge()
+    {
+        tooLarge_ = true;
+        return false;
+    }
+
+    bool start(ValueType type)
+    {
+        if (!put(type, 0))
+            return false;
+        stack_.push_back({ static_cast<uint32_t>(tape_.size() - 1), 0 });
+        return true;
+    }
+
+    bool end(uint64_t tag)
+    {
+        assert(!stack_.empty());
+        if (tape_.size() + 1 > kMaxWords)
+            return tooLarge();
+        auto level = stack_.back();
+        stack_.pop_back();
+
+        auto endIndex = static_cast<uint32_t>(tape_.size());
+        // members are counted twice, once for the key and once for the value
+        uint64_t count = tag == TAG_END_OBJECT ? level.count / 2 : level.count;
+        count = std::min(count, kMaxCount);
+
+        uint64_t& startWord = tape_[level.start];
+        startWord = (startWord & ~kPayloadMask) | count << 32 | endIndex;
+        tape_.push_back(tag << 56 | level.start);
+        return true;
+    }
+
+    std::string_view stringAt(uint64_t offset) const
+    {
+        uint32_t len;
+        memcpy(&len, &strings_[offset], sizeof(len));
+        return std::string_view(&strings_[offset + sizeof(len)], len);
+    }
+
+private:
+    struct Level
+    {
+        uint32_t start;
+        uint64_t count;
+    };
+
+    std::vector<uint64_t> tape_;
+    std::vector<char> strings_;
+    std::vector<Level> stack_;
+    std::string buffer_;
+    bool tooLarge_ = false;
+};
+
+class ImmutableValue::ArrayIterator
+{
+public:
+    ArrayIterator(const ImmutableDocument* doc, uint32_t index):
+            doc_(doc), index_(index)
+    {}
+
+    ImmutableValue operator*() const
+    { return ImmutableValue(doc_, index_); }
+
+    ArrayIterator& operator++()
+    {
+        index_ = ImmutableValue(doc_, index_).next();
+        return *this;
+    }
+
+    bool operator==(const ArrayIterator& rhs) const
+    { return index_ == rhs.index_; }
+    bool operator!=(const ArrayIterator& rhs) const
+    { return index_ != rhs.index_; }
+
+private:
+    const ImmutableDocument* doc_;
+    uint32_t index_;
+};
+
+class ImmutableValue::MemberIterator
+{
+public:
+    MemberIterator(const ImmutableDocument* doc, uint32_t index):
+            doc_(doc), index_(index)
+    {}
+
+    ImmutableMember operator*() const
+    {
+        return ImmutableMember{ ImmutableValue(doc_, index_), ImmutableValue(doc_, index_ + 1) };
+    }
+
+    MemberIterator& operator++()
+    {
+        index_ = ImmutableValue(doc_, index_ + 1).next();
+        return *this;
+    }
+
+    bool operator==(const MemberIterator& rhs) const
+    { return index_ == rhs.index_; }
+    bool operator!=(const MemberIterator& rhs) const
+    { return index_ != rhs.index_; }
+
+private:
+    const ImmutableDocument* doc_;
+    uint32_t index_;
+};
+
+inline uint64_t ImmutableValue::word() const
+{
+    return doc_->tape_[index_];
+}
+
+// index of the word after this value
+inline uint32_t ImmutableValue::next() const
+{
+    switch (getType()) {
+        case TYPE_INT64:
+        case TYPE_DOUBLE:
+            return index_ + 2;
+        case TYPE_ARRAY:
+        case TYPE_OBJECT:
+            return static_cast<uint32_t>(word() & ImmutableDocument::kIndexMask) + 1;
+        default:
+            return index_ + 1;
+    }
+}
+
+inline ValueType ImmutableValue::getType() const
+{
+    auto tag = ImmutableDocument::tagOf(word());
+    assert(tag <= TYPE_OBJECT && "not a value");
+    return static_cast<ValueType>(tag);
+}
+
+inline size_t ImmutableValue::getSize() const
+{
+    if (!isArray() && !isObject())
+        return 1;
+    uint64_t count = (word() & ImmutableDocument::kPayloadMask) >> 32;
+    if (count < ImmutableDocument::kMaxCount)
+        return count;
+
+    // saturated, count the hard way
+    size_t n = 0;
+    if (isArray()) {
+        for (auto it = arrayBegin(); it != arrayEnd(); ++it)
+            n++;
+    }
+    else {
+        for (auto it = memberBegin(); it != memberEnd(); ++it)
+            n++;
+    }
+    return n;
+}
+
+inline bool ImmutableValue::getBool() const
+{
+    assert(getType() == TYPE_BOOL);
+    return (word() & 1) != 0;
+}
+
+inline int32_t ImmutableValue::getInt32() const
+{
+    assert(getType() == TYPE_INT32);
+    return static_cast<int32_t>(static_cast<uint32_t>(word()));
+}
+
+inline int64_t ImmutableValue::getInt64() const
+{
+    assert(isInt64());
+    if (getType() == TYPE_INT32)
+        return getInt32();
+    return static_cast<int64_t>(doc_->tape_[index_ + 1]);
+}
+
+inline double ImmutableValue::getDouble() const
+{
+    assert(getType() == TYPE_DOUBLE);
+    double d;
+    memcpy(&d, &doc_->tape_[index_ + 1], sizeof(d));
+    return d;
+}
+
+inline std::string_view ImmutableValue::getStringView() const
+{
+    assert(getType() == TYPE_STRING);
+    return doc_->stringAt(word() & ImmutableDocument::kPayloadMask);
+}
+
+inline ImmutableValue::ArrayIterator ImmutableValue::arrayBegin() const
+{
+    assert(getType() == TYPE_ARRAY);
+    return ArrayIterator(doc_, index_ + 1);
+}
+
+inline ImmutableValue::ArrayIterator ImmutableValue::arrayEnd() const
+{
+    assert(getType() == TYPE_ARRAY);
+    return ArrayIterator(doc_, next() - 1);
+}
+
+inline ImmutableValue::MemberIterator ImmutableValue::memberBegin() const
+{
+    assert(getType() == TYPE_OBJECT);
+    return MemberIterator(doc_, index_ + 1);
+}
+
+inline ImmutableValue::MemberIterator ImmutableValue::memberEnd() const
+{
+    assert(getType() == TYPE_OBJECT);
+    return MemberIterator(doc_, next() - 1);
+}
+
+inline ImmutableValue::MemberIterator ImmutableValue::findMember(std::string_view key) const
+{
+    auto it = memberBegin();
+    for (auto end = memberEnd(); it != end; ++it) {
+        if ((*it).key.getStringView() == key)
+            break;
+    }
+    return it;
+}
+
+inline ImmutableValue ImmutableValue::operator[] (size_t i) const
+{
+    auto it = arrayBegin();
+    for (; i > 0; i--) {
+        assert(it != arrayEnd());
+        ++it;
+    }
+    assert(it != arrayEnd());
+    return *it;
+}
+
+inline ImmutableValue ImmutableValue::operator[] (std::string_view key) const
+{
+    auto it = findMember(key);
+    assert(it != memberEnd()); // unlike std::map
+    return (*it).value;
+}
+
+#define CALL(expr) do { if (!(expr)) return false; } while(false)
+
+template <typename Handler>
+inline bool ImmutableValue::writeTo(Handler& handler) const
+{
+    switch (getType())
+    {
+        case TYPE_NULL:
+            CALL(handler.Null());
+            break;
+        case TYPE_BOOL:
+            CALL(handler.Bool(getBool()));
+            break;
+        case TYPE_INT32:
+            CALL(handler.Int32(getInt32()));
+            break;
+        case TYPE_INT64:
+            CALL(handler.Int64(getInt64()));
+            break;
+        case TYPE_DOUBLE:
+            CALL(handler.Double(getDouble()));
+            break;
+        case TYPE_STRING:
+            CALL(handler.String(getStringView()));
+            break;
+        case TYPE_ARRAY:
+            CALL(handler.StartArray());
+            for (auto it = arrayBegin(), end = arrayEnd(); it != end; ++it) {
+                CALL((*it).writeTo(handler));
+            }
+            CALL(handler.EndArray());
+            break;
+        case TYPE_OBJECT:
+            CALL(handler.StartObject());
+            for (auto it = memberBegin(), end = memberEnd(); it != end; ++it) {
+                auto member = *it;
+                handler.Key(member.key.getStringView());
+                CALL(member.value.writeTo(handler));
+            }
+            CALL(handler.EndObject());
+            break;
+        default:
+            assert(false && "bad type");
+    }
+    return true;
+}
+
+#undef CALL
+
+}
+
+#endif //TJSON_IMMUTABLEDOCUMENT_H
@@ -0,0 +1,157 @@
+#ifndef TJSON_IOVECWRITESTREAM_H
+#define TJSON_IOVECWRITESTREAM_H
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <hjson/noncopyable.h>
+
+namespace json
+{
+
+//
+// Scatter-gather output: the text is a list of segments, either bytes
+// copied into the stream or references to memory owned by someone else.
+// Writer hands every clean run of a string to putRef(), runs of kMinRef
+// bytes or more are referenced instead of copied, so long strings of a
+// Value go to writeTo()/writev() or sendmsg() straight from the Value.
+//
+// The referenced memory must stay alive and unchanged until the output
+// is written: serialize a Value or Document that outlives the stream,
+// never use it under Reader::parse(), whose strings are temporaries
+//
+class IovecWriteStream: noncopyable
+{
+public:
+    // shorter runs are cheaper to copy than to give their own segment
+    static constexpr size_t kMinRef = 64;
+
+    void put(char c)
+    {
+        grow(1);
+        buffer_.push_back(c);
+    }
+    void put(std::string_view str)
+    {
+        grow(str.size());
+        buffer_.insert(buffer_.end(), str.begin(), str.end());
+    }
+    void putRef(std::string_view str)
+    {
+        if (str.size() < kMinRef) {
+            put(str);
+            return;
+        }
+        if (!segments_.empty()) {
+            Segment& last = segments_.back();
+            if (last.base != nullptr && last.base + last.length == str.data()) {
+                last.length += str.size();
+                size_ += str.size();
+                return;
+            }
+        }
+        segments_.push_back({ str.data(), 0, str.size() });
+        size_ += str.size();
+    }
+
+    // bytes of output
+    size_t size() const
+    { return size_; }
+
+    // valid until the next put()
+    const std::vector<iovec>& iov()
+    {
+        iov_.clear();
+        for (const Segment& seg: segments_) {
+            const char* base = seg.base != nullptr ? seg.base : buffer_.data() + seg.offset;
+            iov_.push_back({ const_cast<char*>(base), seg.length });
+        }
+        return iov_;
+    }
+
+    // writev() in batches of IOV_MAX, 0 or the errno of the failed call
+    int writeTo(int fd)
+    {
+        iov();
+        iovec* vec = iov_.data();
+        size_t count = iov_.size();
+        while (count > 0) {
+            int batch = static_cast<int>(std::min<size_t>(count, IOV_MAX));
+            ssize_t n = ::writev(fd, vec, batch);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return errno;
+            }
+            auto done = static_cast<size_t>(n);
+            while (count > 0 && done >= vec->iov_len) {
+                done -= vec->iov_len;
+                vec++;
+                count--;
+            }
+            if (count > 0) {
+                vec->iov_base = static_cast<char*>(vec->iov_base) + done;
+                vec->iov_len -= done;
+            }
+        }
+        return 0;
+    }
+
+    std::string toString() const
+    {
+        std::string text;
+        text.reserve(size_);
+        for (const Segment& seg: segments_)
+            text.append(seg.base != nullptr ? seg.base : buffer_.data() + seg.offset, seg.length);
+        return text;
+    }
+
+    void clear()
+    {
+        buffer_.clear();
+        segments_.clear();
+        size_ = 0;
+    }
+
+private:
+    // a null base is an offset into buffer_, which may still move
+    struct Segment
+    {
+        const char* base;
+        size_t offset;
+        size_t length;
+    };
+
+    // extends the last segment when it is the tail of buffer_
+    void grow(size_t length)
+    {
+        size_ += length;
+        if (length == 0)
+            return;
+        if (!segments_.empty()) {
+            Segment& last = segments_.back();
+            if (last.base == nullptr && last.offset + last.length == buffer_.size()) {
+                last.length += length;
+                return;
+            }
+        }
+        segments_.push_back({ nullptr, buffer_.size(), length });
+    }
+
+private:
+    std::vector<char> buffer_;
+    std::vector<Segment> segments_;
+    std::vector<iovec> iov_;
+    size_t size_ = 0;
+};
+
+}
+
+#endif //TJSON_IOVECWRITESTREAM_H
@@ -0,0 +1,225 @@
+#ifndef TJSON_PARALLELWRITER_H
+#define TJSON_PARALLELWRITER_H
+
+#include <algorithm>
+#include <cassert>
+#include <string_view>
+#include <memory>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <hjson/StringWriteStream.h>
+#include <hjson/Value.h>
+#include <hjson/Writer.h>
+
+namespace json
+{
+
+//
+// Writes a Value with several threads, byte for byte what a single
+//
+//   Handler<WriteStream> handler(os, args...);  value.writeTo(handler);
+//
+// puts, with Handler being Writer or PrettyWriter. Going down from the
+// root into the biggest child (by element count, the only size known
+// without a walk), the first container with at least one element per
+// thread and no child holding most of it is split into ranges of
+// elements. Each range is written by its own thread through its own
+// Handler on a StringWriteStream. That Handler is first walked down to
+// the split point, through the ancestors and, past the first range, a
+// placeholder element, so its nesting, commas and indentation are those
+// of the sequential writer there; the text before the cut is dropped.
+// The calling thread writes everything around the split container
+// meanwhile and appends the ranges in order.
+//
+// Packed arrays are never split, that would unpack them. The ranges are
+// held in memory until appended, about the size of the output in all
+//
+template <template <typename> class Handler, typename WriteStream, typename... Args>
+class ParallelWriter
+{
+public:
+    ParallelWriter(WriteStream& os, unsigned threads, Args... args):
+            os_(os),
+            threads_(std::max(threads, 1u)),
+            args_(args...)
+    {}
+
+    void write(const Value& value)
+    {
+        path_.clear();
+        const Value* split = findSplit(value);
+        if (split == nullptr) {
+            auto handler = makeHandler(os_);
+            value.writeTo(handler);
+            return;
+        }
+
+        size_t count = split->getSize();
+        size_t ranges = std::min<size_t>(threads_, count);
+        chunks_.reset(new Chunk[ranges]);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < ranges; i++) {
+            size_t begin = count * i / ranges;
+            size_t end = count * (i + 1) / ranges;
+            workers.emplace_back([this, &value, begin, end, i] {
+                writeRange(value, begin, end, chunks_[i]);
+            });
+        }
+
+        auto handler = makeHandler(os_);
+        writeAround(value, 0, handler, workers);
+    }
+
+private:
+    struct Chunk
+    {
+        StringWriteStream os;
+        size_t cut = 0; // where the range starts
+    };
+
+    template <typename Stream>
+    Handler<Stream> makeHandler(Stream& os) const
+    {
+        return std::apply([&os](const auto&... args) {
+            return Handler<Stream>(os, args...);
+        }, args_);
+    }
+
+    static bool splittable(const Value& value)
+    {
+        return (value.isArray() && value.getPackedType() == PACKED_NONE) || value.isObject();
+    }
+
+    static const Value& child(const Value& value, size_t i)
+    {
+        return value.isArray() ? value.getArray()[i] : value.getObject()[i].value;
+    }
+
+    // fills path_ with the child positions leading to it
+    const Value* findSplit(const Value& root)
+    {
+        if (threads_ < 2)
+            return nullptr;
+        const Value* value = &root;
+        while (splittable(*value)) {
+            size_t count = value->getSize();
+            size_t biggest = count;
+            size_t biggestWeight = 0;
+            size_t totalWeight = 0;
+            for (size_t i = 0; i < count; i++) {
+                const Value& c = child(*value, i);
+                size_t weight = splittable(c) ? c.getSize() + 1 : 1;
+                totalWeight += weight;
+                if (splittable(c) && weight > biggestWeight) {
+                    biggest = i;
+                    biggestWeight = weight;
+                }
+            }
+            bool dominated = biggest != count && biggestWeight * 2 > totalWeight;
+            if (count >= threads_ && !dominated)
+                return value;
+            if (biggest == count)
+                return count >= threads_ ? value : nullptr;
+            path_.push_back(biggest);
+            value = &child(*value, biggest);
+        }
+        return nullptr;
+    }
+
+    template <typename H>
+    static void start(const Value& value, H& handler)
+    {
+        if (value.isArray())
+            handler.StartArray();
+        else
+            handler.StartObject();
+    }
+
+    template <typename H>
+    static void writeMember(const Value& value, size_t i, H& handler)
+    {
+        if (value.isObject()) {
+            const Member& member = value.getObject()[i];
+            handler.Key(member.key.getStringView());
+            member.value.writeTo(handler);
+        }
+        else
+            value.getArray()[i].writeTo(handler);
+    }
+
+    // elements [begin, end) of the split container, on a worker
+    void writeRange(const Value& root, size_t begin, size_t end, Chunk& chunk) const
+    {
+        auto handler = makeHandler(chunk.os);
+        const Value* value = &root;
+        for (size_t i: path_) {
+            start(*value, handler);
+            if (value->isObject())
+                handler.Key(value->getObject()[i].key.getStringView());
+            value = &child(*value, i);
+        }
+        start(*value, handler);
+        if (begin > 0) {
+            if (value->isObject())
+                handler.Key("");
+            handler.Null();
+        }
+        chunk.cut = chunk.os.size();
+        for (size_t i = begin; i < end; i++)
+            writeMember(*value, i, handler);
+    }
+
+    // the tree around the split container, with the ranges in its place
+    template <typename H>
+    void writeAround(const Value& value, size_t depth, H& handler,
+                     std::vector<std::thread>& workers)
+    {
+        start(value, handler);
+        if (depth == path_.size()) {
+            for (size_t i = 0; i < workers.size(); i++) {
+                workers[i].join();
+                os_.put(chunks_[i].os.get().substr(chunks_[i].cut));
+            }
+            chunks_.reset();
+        }
+        else {
+            for (size_t i = 0; i < value.getSize(); i++) {
+                if (i != path_[depth])
+                    writeMember(value, i, handler);
+                else {
+                    if (value.isObject())
+                        handler.Key(value.getObject()[i].key.getStringView());
+                    writeAround(child(value, i), depth + 1, handler, workers);
+                }
+            }
+        }
+        if (value.isArray())
+            handler.EndArray();
+        else
+            handler.EndObject();
+    }
+
+private:
+    WriteStream& os_;
+    unsigned threads_;
+    std::tuple<Args...> args_;
+    std::vector<size_t> path_;
+    std::unique_ptr<Chunk[]> chunks_;
+};
+
+//
+// value through Handler (Writer, PrettyWriter) on os with threads
+// threads, see ParallelWriter. args follow os to the Handler
+//
+template <template <typename> class Handler, typename WriteStream, typename... Args>
+inline void writeParallel(const Value& value, WriteStream& os, unsigned threads, Args... args)
+{
+    ParallelWriter<Handler, WriteStream, Args...> writer(os, threads, args...);
+    writer.write(value);
+}
+
+}
+
+#endif //TJSON_PARALLELWRITER_H
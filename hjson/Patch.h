@@ -0,0 +1,359 @@
+#ifndef TJSON_PATCH_H
+#define TJSON_PATCH_H
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <string_view>
+
+#include <hjson/Pointer.h>
+#include <hjson/Value.h>
+
+namespace json
+{
+
+#define PATCH_ERROR_MAP(XX) \
+  XX(OK, "ok") \
+  XX(NOT_ARRAY, "patch is not an array") \
+  XX(BAD_OPERATION, "bad operation") \
+  XX(BAD_POINTER, "bad pointer") \
+  XX(PATH_NOT_FOUND, "path not found") \
+  XX(BAD_INDEX, "array index out of range") \
+  XX(MOVE_INTO_CHILD, "move into own child") \
+  XX(TEST_FAILED, "test failed")
+
+enum PatchError {
+#define GEN_ERRNO(e, s) PATCH_##e,
+    PATCH_ERROR_MAP(GEN_ERRNO)
+#undef GEN_ERRNO
+};
+
+inline const char* patchErrorStr(PatchError err)
+{
+    const static char* tab[] = {
+#define GEN_STRERR(e, n) n,
+            PATCH_ERROR_MAP(GEN_STRERR)
+#undef GEN_STRERR
+    };
+    assert(err >= 0 && err < sizeof(tab) / sizeof(tab[0]));
+    return tab[err];
+}
+
+#undef PATCH_ERROR_MAP
+
+//
+// Patches are applied through copy-on-write: only the arrays and objects
+// on the path to a change are copied, untouched subtrees stay shared with
+// the original (and with the patch, for the values it inserts)
+//
+
+// RFC 7396 JSON Merge Patch, in place
+inline void mergePatch(Value& target, const Value& patch)
+{
+    if (!patch.isObject()) {
+        target = patch;
+        return;
+    }
+    if (!target.isObject())
+        target.setObject();
+
+    const Value& ctarget = target;
+    for (auto& member: patch.getObject()) {
+        auto key = member.key.getStringView();
+        bool exists = ctarget.findMember(key) != ctarget.memberEnd();
+        if (member.value.isNull()) {
+            if (exists)
+                target.removeMember(key);
+        }
+        else if (exists)
+            mergePatch(target[key], member.value);
+        else
+            mergePatch(target.addMember(Value(member.key), Value(TYPE_NULL)), member.value);
+    }
+}
+
+namespace detail
+{
+
+// RFC 6902 equality: like Value::operator== but numbers compare by value
+inline bool patchEqual(const Value& lhs, const Value& rhs)
+{
+    auto isNumber = [](const Value& v) { return v.isInt64() || v.isDouble(); };
+    if (lhs.isDouble() != rhs.isDouble() && isNumber(lhs) && isNumber(rhs)) {
+        auto toDouble = [](const Value& v) {
+            return v.isDouble() ? v.getDouble() : static_cast<double>(v.getInt64());
+        };
+        return toDouble(lhs) == toDouble(rhs);
+    }
+    if (lhs.getType() != rhs.getType() || lhs.sameStorage(rhs))
+        return lhs == rhs;
+
+    if (lhs.isArray()) {
+        if (lhs.getSize() != rhs.getSize())
+            return false;
+        for (size_t i = 0; i < lhs.getSize(); i++) {
+            if (!patchEqual(lhs[i], rhs[i]))
+                return false;
+        }
+        return true;
+    }
+    if (lhs.isObject()) {
+        if (lhs.getSize() != rhs.getSize())
+            return false;
+        for (auto& member: lhs.getObject()) {
+            auto it = rhs.findMember(member.key.getStringView());
+            if (it == rhs.memberEnd() || !patchEqual(member.value, it->value))
+                return false;
+        }
+        return true;
+    }
+    return lhs == rhs;
+}
+
+inline PatchError patchAdd(Value& root, const CompiledPointer& path, Value&& value)
+{
+    if (path.size() == 0) {
+        root = std::move(value);
+        return PATCH_OK;
+    }
+    Value* parent = path.parent(root);
+    if (parent == nullptr)
+        return PATCH_PATH_NOT_FOUND;
+
+    size_t last = path.size() - 1;
+    if (parent->isArray()) {
+        size_t index = path.token(last) == "-" ? parent->getSize() : path.index(last);
+        if (index == CompiledPointer::npos || index > parent->getSize())
+            return PATCH_BAD_INDEX;
+        parent->insertValue(index, std::move(value));
+        return PATCH_OK;
+    }
+    if (parent->isObject()) {
+        const Value& cparent = *parent;
+        if (cparent.findMember(path.token(last)) != cparent.memberEnd())
+            (*parent)[path.token(last)] = std::move(value);
+        else
+            parent->addMember(Value(path.token(last)), std::move(value));
+        return PATCH_OK;
+    }
+    return PATCH_PATH_NOT_FOUND;
+}
+
+inline PatchError patchRemove(Value& root, const CompiledPointer& path, Value* removed = nullptr)
+{
+    if (path.size() == 0)
+        return PATCH_BAD_OPERATION; // the document itself
+    const Value* target = path.get(static_cast<const Value&>(root));
+    if (target == nullptr)
+        return PATCH_PATH_NOT_FOUND;
+    if (removed != nullptr)
+        *removed = *target;
+
+    Value* parent = path.parent(root);
+    size_t last = path.size() - 1;
+    if (parent->isArray())
+        parent->eraseValue(path.index(last));
+    else
+        parent->removeMember(path.token(last));
+    return PATCH_OK;
+}
+
+inline PatchError patchOperation(Value& root, const Value& operation)
+{
+    if (!operation.isObject())
+        return PATCH_BAD_OPERATION;
+
+    auto field = [&operation](std::string_view name) -> const Value* {
+        auto it = operation.findMember(name);
+        return it == operation.memberEnd() ? nullptr : &it->value;
+    };
+    const Value* op = field("op");
+    const Value* pathString = field("path");
+    if (op == nullptr || !op->isString() || pathString == nullptr || !pathString->isString())
+        return PATCH_BAD_OPERATION;
+
+    CompiledPointer path(pathString->getStringView());
+    if (!path.isValid())
+        return PATCH_BAD_POINTER;
+
+    auto name = op->getStringView();
+    if (name == "add" || name == "replace" || name == "test") {
+        const Value* value = field("value");
+        if (value == nullptr)
+            return PATCH_BAD_OPERATION;
+        if (name == "add")
+            return patchAdd(root, path, Value(*value));
+
+        const Value* target = path.get(static_cast<const Value&>(root));
+        if (target == nullptr)
+            return PATCH_PATH_NOT_FOUND;
+        if (name == "test")
+            return patchEqual(*target, *value) ? PATCH_OK : PATCH_TEST_FAILED;
+        *path.get(root) = *value;
+        return PATCH_OK;
+    }
+    if (name == "remove")
+        return patchRemove(root, path);
+
+    if (name == "move" || name == "copy") {
+        const Value* fromString = field("from");
+        if (fromString == nullptr || !fromString->isString())
+            return PATCH_BAD_OPERATION;
+        CompiledPointer from(fromString->getStringView());
+        if (!from.isValid())
+            return PATCH_BAD_POINTER;
+
+        Value value;
+        if (name == "copy") {
+            const Value* source = from.get(static_cast<const Value&>(root));
+            if (source == nullptr)
+                return PATCH_PATH_NOT_FOUND;
+            value = *source;
+        }
+        else {
+            if (from.isProperPrefixOf(path))
+                return PATCH_MOVE_INTO_CHILD;
+            if (from.size() == 0) {
+                // moving the document onto itself
+                if (from.get(static_cast<const Value&>(root)) == nullptr)
+                    return PATCH_PATH_NOT_FOUND;
+                return PATCH_OK;
+            }
+            PatchError err = patchRemove(root, from, &value);
+            if (err != PATCH_OK)
+                return err;
+        }
+        return patchAdd(root, path, std::move(value));
+    }
+    return PATCH_BAD_OPERATION;
+}
+
+}
+
+//
+// RFC 6902 JSON Patch, atomic: on error target is left unchanged. The
+// operations run on a shallow copy, the cost is proportional to the
+// paths they touch rather than to the size of the document
+//
+inline PatchError applyPatch(Value& target, const Value& patch)
+{
+    if (!patch.isArray())
+        return PATCH_NOT_ARRAY;
+
+    Value result = target;
+    for (auto& operation: patch.getArray()) {
+        PatchError err = detail::patchOperation(result, operation);
+        if (err != PATCH_OK)
+            return err;
+    }
+    target = std::move(result);
+    return PATCH_OK;
+}
+
+namespace detail
+{
+
+inline void appendToken(std::string& path, std::string_view token)
+{
+    path.push_back('/');
+    for (char ch: token) {
+        if (ch == '~')
+            path += "~0";
+        else if (ch == '/')
+            path += "~1";
+        else
+            path.push_back(ch);
+    }
+}
+
+inline void addOperation(Value& patch, const char* op, const std::string& path, const Value* value)
+{
+    Value& operation = patch.addValue(Value(TYPE_OBJECT));
+    operation.addMember("op", op);
+    operation.addMember("path", std::string_view(path));
+    if (value != nullptr)
+        operation.addMember(Value("value"), Value(*value));
+}
+
+inline void diffValues(const Value& a, const Value& b, std::string& path, Value& patch)
+{
+    if (a.sameStorage(b))
+        return;
+
+    size_t length = path.size();
+    if (a.isObject() && b.isObject()) {
+        for (auto& member: a.getObject()) {
+            auto key = member.key.getStringView();
+            appendToken(path, key);
+            auto it = b.findMember(key);
+            if (it == b.memberEnd())
+                addOperation(patch, "remove", path, nullptr);
+            else
+                diffValues(member.value, it->value, path, patch);
+            path.resize(length);
+        }
+        for (auto& member: b.getObject()) {
+            auto key = member.key.getStringView();
+            if (a.findMember(key) == a.memberEnd()) {
+                appendToken(path, key);
+                addOperation(patch, "add", path, &member.value);
+                path.resize(length);
+            }
+        }
+    }
+    else if (a.isArray() && b.isArray()) {
+        // an insertion or removal inside a long array stays one operation
+        auto& lhs = a.getArray();
+        auto& rhs = b.getArray();
+        size_t prefix = 0;
+        while (prefix < lhs.size() && prefix < rhs.size() && lhs[prefix] == rhs[prefix])
+            prefix++;
+        size_t suffix = 0;
+        while (suffix < lhs.size() - prefix && suffix < rhs.size() - prefix &&
+               lhs[lhs.size() - 1 - suffix] == rhs[rhs.size() - 1 - suffix])
+            suffix++;
+
+        size_t lhsEnd = lhs.size() - suffix;
+        size_t rhsEnd = rhs.size() - suffix;
+        size_t common = std::min(lhsEnd, rhsEnd);
+        for (size_t i = prefix; i < common; i++) {
+            path += '/' + std::to_string(i);
+            diffValues(lhs[i], rhs[i], path, patch);
+            path.resize(length);
+        }
+        for (size_t i = lhsEnd; i > common; i--) {
+            path += '/' + std::to_string(i - 1);
+            addOperation(patch, "remove", path, nullptr);
+            path.resize(length);
+        }
+        for (size_t i = common; i < rhsEnd; i++) {
+            path += '/' + std::to_string(i);
+            addOperation(patch, "add", path, &rhs[i]);
+            path.resize(length);
+        }
+    }
+    else if (a != b)
+        addOperation(patch, "replace", path, &b);
+}
+
+}
+
+//
+// JSON Patch turning a into b. Nodes shared by both sides (copies, patch
+// results, deduplicated documents) are skipped without a walk, so the
+// cost follows the size of the change. Mismatching array elements are
+// rejected early when their hashes are cached (Value::hash()). Member
+// order is not compared, arrays are diffed by position after trimming
+// their common prefix and suffix
+//
+inline Value diff(const Value& a, const Value& b)
+{
+    Value patch(TYPE_ARRAY);
+    std::string path;
+    detail::diffValues(a, b, path, patch);
+    return patch;
+}
+
+}
+
+#endif //TJSON_PATCH_H
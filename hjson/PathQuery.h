@@ -0,0 +1,364 @@
+#ifndef TJSON_PATHQUERY_H
+#define TJSON_PATHQUERY_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include <hjson/Document.h>
+#include <hjson/Reader.h>
+
+namespace json
+{
+
+//
+// JSONPath subset evaluated over Reader events, no DOM is built for the
+// input. Supported steps:
+//
+//   .name  ['name']  ["name"]    member
+//   .*  [*]                      every member or element
+//   [n]  [start:end:step]        elements, indices are not negative
+//
+// e.g. $.records[*].user['id']. Without recursive descent every step
+// matches at exactly one depth, so the compiled query is a linear
+// automaton and the state is the depth reached on the path
+//
+class PathQuery
+{
+public:
+    struct Step
+    {
+        enum Kind { NAME, WILDCARD, SLICE };
+
+        bool matches(std::string_view key) const
+        { return kind == WILDCARD || (kind == NAME && key == name); }
+
+        bool matches(size_t index) const
+        {
+            if (kind == WILDCARD)
+                return true;
+            return kind == SLICE && index >= start && index < end && (index - start) % step == 0;
+        }
+
+        Kind kind;
+        std::string name;
+        size_t start = 0;
+        size_t end = SIZE_MAX;
+        size_t step = 1;
+    };
+
+    explicit PathQuery(std::string_view path)
+    {
+        valid_ = compile(path);
+        if (!valid_)
+            steps_.clear();
+    }
+
+    bool isValid() const
+    { return valid_; }
+
+    size_t size() const
+    { return steps_.size(); }
+
+    const Step& step(size_t i) const
+    { return steps_[i]; }
+
+    //
+    // calls callback(const Value&) for every match in document order, the
+    // value is only valid during the call. A callback returning bool stops
+    // the parse with PARSE_USER_STOPPED when it returns false
+    //
+    template <typename ReadStream, typename Callback>
+    ParseError runStream(ReadStream& is, Callback&& callback) const;
+
+    template <typename Callback>
+    ParseError run(std::string_view json, Callback&& callback) const;
+
+private:
+    bool compile(std::string_view path);
+
+    static bool parseIndex(std::string_view text, size_t& value)
+    {
+        if (text.empty() || text.size() > 18)
+            return false;
+        value = 0;
+        for (char ch: text) {
+            if (ch < '0' || ch > '9')
+                return false;
+            value = value * 10 + static_cast<size_t>(ch - '0');
+        }
+        return true;
+    }
+
+private:
+    std::vector<Step> steps_;
+    bool valid_;
+};
+
+//
+// Handler for Reader::parse(), values off the path are skipped by the
+// reader, a matched array or object is built into a reused Document
+//
+template <typename Callback>
+class PathQueryHandler: noncopyable
+{
+public:
+    PathQueryHandler(const PathQuery& query, Callback& callback):
+            query_(query),
+            callback_(callback)
+    {}
+
+public: // handler
+    bool Null()
+    {
+        if (capturing_ > 0)
+            return doc_.Null();
+        return scalar([] { return Value(TYPE_NULL); });
+    }
+    bool Bool(bool b)
+    {
+        if (capturing_ > 0)
+            return doc_.Bool(b);
+        return scalar([b] { return Value(b); });
+    }
+    bool Int32(int32_t i32)
+    {
+        if (capturing_ > 0)
+            return doc_.Int32(i32);
+        return scalar([i32] { return Value(i32); });
+    }
+    bool Int64(int64_t i64)
+    {
+        if (capturing_ > 0)
+            return doc_.Int64(i64);
+        return scalar([i64] { return Value(i64); });
+    }
+    bool Double(double d)
+    {
+        if (capturing_ > 0)
+            return doc_.Double(d);
+        return scalar([d] { return Value(d); });
+    }
+    bool String(std::string_view s)
+    {
+        if (capturing_ > 0)
+            return doc_.String(s);
+        return scalar([s] { return Value(s); });
+    }
+    bool Key(std::string_view s)
+    {
+        if (capturing_ > 0)
+            return doc_.Key(s);
+        auto& top = frames_.back();
+        top.keyMatches = top.onPath && query_.step(frames_.size() - 1).matches(s);
+        return true;
+    }
+    bool StartObject()
+    { return start(false); }
+    bool EndObject()
+    { return end(false); }
+    bool StartArray()
+    { return start(true); }
+    bool EndArray()
+    { return end(true); }
+
+    // asked by the reader before every element and member value
+    bool skipValue()
+    {
+        if (capturing_ > 0)
+            return false;
+        State state = enter();
+        if (state == DEAD)
+            return true;
+        pending_ = state;
+        hasPending_ = true;
+        return false;
+    }
+
+private:
+    enum State { DEAD, ON_PATH, MATCH };
+
+    struct Frame
+    {
+        bool onPath;
+        bool isArray;
+        bool keyMatches;
+        size_t index;
+    };
+
+    // state of the value that starts now
+    State enter()
+    {
+        if (hasPending_) {
+            hasPending_ = false;
+            return pending_;
+        }
+
+        size_t depth = frames_.size();
+        if (depth > 0) {
+            auto& top = frames_.back();
+            bool accepted = top.isArray ? query_.step(depth - 1).matches(top.index) : top.keyMatches;
+            if (top.isArray)
+                top.index++;
+            if (!top.onPath || !accepted)
+                return DEAD;
+        }
+        return depth == query_.size() ? MATCH : ON_PATH;
+    }
+
+    template <typename Make>
+    bool scalar(Make make)
+    {
+        if (enter() != MATCH)
+            return true;
+        return deliver(make());
+    }
+
+    bool start(bool isArray)
+    {
+        if (capturing_ > 0) {
+            capturing_++;
+            return isArray ? doc_.StartArray() : doc_.StartObject();
+        }
+
+        State state = enter();
+        if (state == MATCH) {
+            capturing_ = 1;
+            doc_.clear();
+            return isArray ? doc_.StartArray() : doc_.StartObject();
+        }
+        frames_.push_back(Frame{ state == ON_PATH, isArray, false, 0 });
+        return true;
+    }
+
+    bool end(bool isArray)
+    {
+        if (capturing_ > 0) {
+            if (!(isArray ? doc_.EndArray() : doc_.EndObject()))
+                return false;
+            if (--capturing_ > 0)
+                return true;
+            return deliver(doc_);
+        }
+        frames_.pop_back();
+        return true;
+    }
+
+    bool deliver(const Value& value)
+    {
+        if constexpr (std::is_same_v<decltype(callback_(value)), bool>)
+            return callback_(value);
+        else {
+            callback_(value);
+            return true;
+        }
+    }
+
+private:
+    const PathQuery& query_;
+    Callback& callback_;
+    std::vector<Frame> frames_;
+    // state decided in skipValue() for the value that follows
+    State pending_ = DEAD;
+    bool hasPending_ = false;
+    // nesting inside the matched array or object being built
+    size_t capturing_ = 0;
+    Document doc_;
+};
+
+template <typename ReadStream, typename Callback>
+inline ParseError PathQuery::runStream(ReadStream& is, Callback&& callback) const
+{
+    assert(valid_);
+    PathQueryHandler<std::remove_reference_t<Callback>> handler(*this, callback);
+    return Reader::parse(is, handler);
+}
+
+template <typename Callback>
+inline ParseError PathQuery::run(std::string_view json, Callback&& callback) const
+{
+    StringReadStream is(json);
+    return runStream(is, std::forward<Callback>(callback));
+}
+
+inline bool PathQuery::compile(std::string_view path)
+{
+    if (path.empty() || path[0] != '$')
+        return false;
+
+    size_t i = 1;
+    while (i < path.size()) {
+        Step step;
+        if (path[i] == '.') {
+            size_t begin = ++i;
+            while (i < path.size() && path[i] != '.' && path[i] != '[')
+                i++;
+            std::string_view name = path.substr(begin, i - begin);
+            if (name.empty())
+                return false;
+            if (name == "*")
+                step.kind = Step::WILDCARD;
+            else {
+                step.kind = Step::NAME;
+                step.name = name;
+            }
+        }
+        else if (path[i] == '[') {
+            size_t close;
+            char quote = i + 1 < path.size() ? path[i + 1] : '\0';
+            if (quote == '\'' || quote == '"') {
+                step.kind = Step::NAME;
+                for (i += 2; i < path.size() && path[i] != quote; i++) {
+                    if (path[i] == '\\' && ++i == path.size())
+                        return false;
+                    step.name.push_back(path[i]);
+                }
+                if (i + 1 >= path.size() || path[i + 1] != ']')
+                    return false;
+                close = i + 1;
+            }
+            else {
+                close = path.find(']', i);
+                if (close == std::string_view::npos)
+                    return false;
+                std::string_view inner = path.substr(i + 1, close - i - 1);
+                if (inner == "*")
+                    step.kind = Step::WILDCARD;
+                else {
+                    step.kind = Step::SLICE;
+                    size_t colon = inner.find(':');
+                    if (colon == std::string_view::npos) {
+                        if (!parseIndex(inner, step.start))
+                            return false;
+                        step.end = step.start + 1;
+                    }
+                    else {
+                        std::string_view from = inner.substr(0, colon);
+                        std::string_view rest = inner.substr(colon + 1);
+                        std::string_view to = rest.substr(0, rest.find(':'));
+                        if (!from.empty() && !parseIndex(from, step.start))
+                            return false;
+                        if (!to.empty() && !parseIndex(to, step.end))
+                            return false;
+                        if (to.size() < rest.size()) {
+                            std::string_view by = rest.substr(to.size() + 1);
+                            if (!by.empty() && (!parseIndex(by, step.step) || step.step == 0))
+                                return false;
+                        }
+                    }
+                }
+            }
+            i = close + 1;
+        }
+        else
+            return false;
+        steps_.push_back(std::move(step));
+    }
+    return true;
+}
+
+}
+
+#endif //TJSON_PATHQUERY_H
@@ -0,0 +1,196 @@
+#ifndef TJSON_POINTER_H
+#define TJSON_POINTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <hjson/Value.h>
+
+namespace json
+{
+
+//
+// RFC 6901 JSON Pointer, parsed and unescaped once. Every object step
+// remembers the member position it matched last time and tries it first,
+// so a pointer evaluated against many documents of the same layout skips
+// the key lookup. The hints are relaxed atomics, one pointer can be used
+// from several threads
+//
+class CompiledPointer
+{
+public:
+    static constexpr size_t npos = SIZE_MAX;
+
+    explicit CompiledPointer(std::string_view pointer)
+    {
+        valid_ = parse(pointer);
+        if (!valid_)
+            tokens_.clear();
+    }
+
+    bool isValid() const
+    { return valid_; }
+
+    // number of reference tokens, 0 for the whole document
+    size_t size() const
+    { return tokens_.size(); }
+
+    // unescaped reference token
+    std::string_view token(size_t i) const
+    { return tokens_[i].name; }
+
+    // array index of a token, npos when it is not one ("-" is not)
+    size_t index(size_t i) const
+    { return tokens_[i].index; }
+
+    // nullptr when the pointer is invalid or the value does not exist
+    const Value* get(const Value& root) const
+    {
+        if (!valid_)
+            return nullptr;
+        const Value* value = &root;
+        for (auto& token: tokens_) {
+            size_t pos = locate(*value, token);
+            if (pos == npos)
+                return nullptr;
+            value = value->isArray() ? &(*value)[pos]
+                                     : &value->getObject()[pos].value;
+        }
+        return value;
+    }
+
+    // mutable access, copies shared nodes along the path
+    Value* get(Value& root) const
+    { return valid_ ? walk(root, tokens_.size()) : nullptr; }
+
+    // the array or object holding the last token, nullptr for the root
+    Value* parent(Value& root) const
+    { return valid_ && !tokens_.empty() ? walk(root, tokens_.size() - 1) : nullptr; }
+
+    // rhs refers to a value strictly inside the one this refers to
+    bool isProperPrefixOf(const CompiledPointer& rhs) const
+    {
+        if (tokens_.size() >= rhs.tokens_.size())
+            return false;
+        for (size_t i = 0; i < tokens_.size(); i++) {
+            if (tokens_[i].name != rhs.tokens_[i].name)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    struct Token
+    {
+        Token(std::string name_, size_t index_):
+                name(std::move(name_)),
+                index(index_)
+        {}
+        Token(const Token& rhs):
+                name(rhs.name),
+                index(rhs.index),
+                hint(rhs.hint.load(std::memory_order_relaxed))
+        {}
+
+        std::string name;
+        size_t index;
+        // member position matched by the last lookup
+        mutable std::atomic<uint32_t> hint{0};
+    };
+
+    bool parse(std::string_view pointer)
+    {
+        if (pointer.empty())
+            return true;
+        if (pointer[0] != '/')
+            return false;
+
+        size_t begin = 1;
+        while (true) {
+            size_t end = pointer.find('/', begin);
+            if (end == std::string_view::npos)
+                end = pointer.size();
+
+            std::string name;
+            for (size_t i = begin; i < end; i++) {
+                char ch = pointer[i];
+                if (ch == '~') {
+                    if (++i == end)
+                        return false;
+                    if (pointer[i] == '0')
+                        ch = '~';
+                    else if (pointer[i] == '1')
+                        ch = '/';
+                    else
+                        return false;
+                }
+                name.push_back(ch);
+            }
+            size_t index = toIndex(name);
+            tokens_.emplace_back(std::move(name), index);
+
+            if (end == pointer.size())
+                return true;
+            begin = end + 1;
+        }
+    }
+
+    // "0" or digits without a leading zero
+    static size_t toIndex(std::string_view name)
+    {
+        if (name.empty() || name.size() > 9 || (name[0] == '0' && name.size() > 1))
+            return npos;
+        size_t index = 0;
+        for (char ch: name) {
+            if (ch < '0' || ch > '9')
+                return npos;
+            index = index * 10 + static_cast<size_t>(ch - '0');
+        }
+        return index;
+    }
+
+    Value* walk(Value& root, size_t count) const
+    {
+        Value* value = &root;
+        for (size_t i = 0; i < count; i++) {
+            size_t pos = locate(*value, tokens_[i]);
+            if (pos == npos)
+                return nullptr;
+            value = value->isArray() ? &(*value)[pos] : &value->getMemberValue(pos);
+        }
+        return value;
+    }
+
+    // position of the token in an array or object, npos when absent
+    static size_t locate(const Value& value, const Token& token)
+    {
+        if (value.isArray())
+            return token.index < value.getSize() ? token.index : npos;
+        if (!value.isObject())
+            return npos;
+
+        auto& members = value.getObject();
+        uint32_t hint = token.hint.load(std::memory_order_relaxed);
+        if (hint < members.size() && members[hint].key.getStringView() == token.name)
+            return hint;
+
+        auto it = value.findMember(token.name);
+        if (it == members.end())
+            return npos;
+        auto pos = static_cast<uint32_t>(it - members.begin());
+        token.hint.store(pos, std::memory_order_relaxed);
+        return pos;
+    }
+
+private:
+    std::vector<Token> tokens_;
+    bool valid_;
+};
+
+}
+
+#endif //TJSON_POINTER_H
@@ -54,6 +54,13 @@ public:
         return true;
     }
 
+    bool RawNumber(std::string_view text)
+    {
+        writer_.RawNumber(text);
+        keepIndent();
+        return true;
+    }
+
     bool String(std::string_view s)
     {
         writer_.String(s);
@@ -75,6 +82,13 @@ public:
         return true;
     }
 
+    bool EscapedKey(std::string_view quoted)
+    {
+        expectObjectValue_ = true;
+        writer_.EscapedKey(quoted);
+        return true;
+    }
+
     bool EndObject()
     {
         decrIndent();
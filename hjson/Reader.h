@@ -3,7 +3,12 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 #include <stdexcept>
 
@@ -16,15 +21,35 @@
 namespace json
 {
 
+//
+// A handler with a 'bool skipValue()' member is asked before every array
+// element and member value; when it returns true the value is skipped
+// without any event. Skipped values are only scanned for brackets and
+// strings, their scalars are not validated.
+//
+// A handler with 'bool rawNumbers()' returning true gets the source text
+// of every double through 'bool RawNumber(std::string_view)' instead of
+// Double(), the text is validated but not converted (so out of range
+// doubles are not reported)
+//
 class Reader: noncopyable
 {
 public:
     template <typename ReadStream, typename Handler>
     static ParseError parse(ReadStream& is, Handler& handler)
+    {
+        // scratch space for unescaping, shared by all strings of this parse
+        std::string buffer;
+        return parse(is, handler, buffer);
+    }
+
+    // long-lived handlers pass their own scratch buffer to keep its capacity
+    template <typename ReadStream, typename Handler>
+    static ParseError parse(ReadStream& is, Handler& handler, std::string& buffer)
     {
         try {
             parseWhitespace(is);
-            parseValue(is, handler);
+            parseValue(is, handler, buffer);
             parseWhitespace(is);
             if (is.hasNext())
                 throw Exception(PARSE_ROOT_NOT_SINGULAR);
@@ -34,6 +59,61 @@ public:
         }
     }
 
+    //
+    // structural pre-pass: counts[i] receives the number of elements of the
+    // i-th array or object in document order. Only brackets, commas and
+    // strings are looked at, counts are meaningless for invalid JSON
+    //
+    static void countElements(std::string_view json, std::vector<uint32_t>& counts,
+                              std::vector<uint32_t>& open)
+    {
+        counts.clear();
+        open.clear();
+        const char* p = json.data();
+        const char* end = p + json.size();
+        while (p != end) {
+            // most bytes are not structural, skip them in a tight loop
+            while (p != end && !isStructural(*p))
+                p++;
+            if (p == end)
+                break;
+            switch (*p++) {
+                case '"':
+                    while (true) {
+                        p = static_cast<const char*>(memchr(p, '"', static_cast<size_t>(end - p)));
+                        if (p == nullptr)
+                            return;
+                        // escaped if preceded by an odd number of backslashes
+                        const char* q = p;
+                        while (q[-1] == '\\')
+                            q--;
+                        p++;
+                        if ((p - q) % 2 == 1)
+                            break;
+                    }
+                    break;
+                case '[':
+                case '{': {
+                    open.push_back(static_cast<uint32_t>(counts.size()));
+                    const char* q = p;
+                    while (q != end && (*q == ' ' || *q == '\t' || *q == '\r' || *q == '\n'))
+                        q++;
+                    counts.push_back(q != end && *q != ']' && *q != '}');
+                    break;
+                }
+                case ']':
+                case '}':
+                    if (!open.empty())
+                        open.pop_back();
+                    break;
+                default: // ','
+                    if (!open.empty())
+                        counts[open.back()]++;
+                    break;
+            }
+        }
+    }
+
 private:
 
 #define CALL(expr) \
@@ -181,6 +261,12 @@ private:
             // because new string buffer is needed
             //
             std::size_t idx;
+            if constexpr (WantsRawNumbers<Handler>::value) {
+                if (expectType == TYPE_DOUBLE && handler.rawNumbers()) {
+                    CALL(handler.RawNumber(std::string_view(&*start, static_cast<size_t>(end - start))));
+                    return;
+                }
+            }
             if (expectType == TYPE_DOUBLE) {
                 double d = __gnu_cxx::__stoa(&std::strtod, "stod", &*start, &idx);
                 assert(start + idx == end);
@@ -217,18 +303,18 @@ private:
     }
 
     template <typename ReadStream, typename Handler>
-    static void parseString(ReadStream& is, Handler& handler, bool isKey)
+    static void parseString(ReadStream& is, Handler& handler, bool isKey, std::string& buffer)
     {
         is.assertNext('"');
-        std::string buffer;
+        buffer.clear();
         while (is.hasNext()) {
             switch (char ch = is.next()) {
                 case '"':
                     if (isKey) {
-                        CALL(handler.Key(std::move(buffer)));
+                        CALL(handler.Key(buffer));
                     }
                     else {
-                        CALL(handler.String(std::move(buffer)));
+                        CALL(handler.String(buffer));
                     }
                     return;
                 case '\x01'...'\x1f':
@@ -270,7 +356,7 @@ private:
     }
 
     template <typename ReadStream, typename Handler>
-    static void parseArray(ReadStream& is, Handler& handler)
+    static void parseArray(ReadStream& is, Handler& handler, std::string& buffer)
     {
         CALL(handler.StartArray());
 
@@ -283,7 +369,7 @@ private:
         }
 
         while (true) {
-            parseValue(is, handler);
+            parseElement(is, handler, buffer);
             parseWhitespace(is);
             switch (is.next()) {
                 case ',':
@@ -299,7 +385,7 @@ private:
     }
 
     template <typename ReadStream, typename Handler>
-    static void parseObject(ReadStream& is, Handler& handler)
+    static void parseObject(ReadStream& is, Handler& handler, std::string& buffer)
     {
         CALL(handler.StartObject());
 
@@ -316,7 +402,7 @@ private:
             if (is.peek() != '"')
                 throw Exception(PARSE_MISS_KEY);
 
-            parseString(is, handler, true);
+            parseString(is, handler, true, buffer);
 
             // parse ':'
             parseWhitespace(is);
@@ -325,7 +411,7 @@ private:
             parseWhitespace(is);
 
             // go on
-            parseValue(is, handler);
+            parseElement(is, handler, buffer);
             parseWhitespace(is);
             switch (is.next()) {
                 case ',':
@@ -342,8 +428,83 @@ private:
 
 #undef CALL
 
+    template <typename Handler, typename = void>
+    struct WantsRawNumbers: std::false_type {};
+
+    template <typename Handler>
+    struct WantsRawNumbers<Handler, std::void_t<decltype(std::declval<Handler&>().rawNumbers())>>:
+            std::true_type {};
+
+    template <typename Handler, typename = void>
+    struct HasSkipValue: std::false_type {};
+
+    template <typename Handler>
+    struct HasSkipValue<Handler, std::void_t<decltype(std::declval<Handler&>().skipValue())>>:
+            std::true_type {};
+
+    // array element or member value
+    template <typename ReadStream, typename Handler>
+    static void parseElement(ReadStream& is, Handler& handler, std::string& buffer)
+    {
+        if constexpr (HasSkipValue<Handler>::value) {
+            if (handler.skipValue()) {
+                skipValue(is);
+                return;
+            }
+        }
+        parseValue(is, handler, buffer);
+    }
+
+    template <typename ReadStream>
+    static void skipValue(ReadStream& is)
+    {
+        size_t depth = 0;
+        do {
+            if (!is.hasNext())
+                throw Exception(depth == 0 ? PARSE_EXPECT_VALUE : PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+            switch (is.peek()) {
+                case '"':
+                    is.next();
+                    while (true) {
+                        if (!is.hasNext())
+                            throw Exception(PARSE_MISS_QUOTATION_MARK);
+                        char ch = is.next();
+                        if (ch == '"')
+                            break;
+                        if (ch == '\\')
+                            is.next();
+                    }
+                    break;
+                case '[':
+                case '{':
+                    is.next();
+                    depth++;
+                    break;
+                case ']':
+                case '}':
+                    if (depth == 0)
+                        throw Exception(PARSE_BAD_VALUE);
+                    is.next();
+                    depth--;
+                    break;
+                case ',':
+                case ':':
+                    if (depth == 0)
+                        throw Exception(PARSE_BAD_VALUE);
+                    is.next();
+                    break;
+                default:
+                    // scalar or whitespace, up to the next delimiter
+                    do {
+                        is.next();
+                    } while (is.hasNext() && !isDelimiter(is.peek()));
+                    break;
+            }
+        } while (depth > 0);
+    }
+
     template <typename ReadStream, typename Handler>
-    static void parseValue(ReadStream& is, Handler& handler)
+    static void parseValue(ReadStream& is, Handler& handler, std::string& buffer)
     {
         if (!is.hasNext())
             throw Exception(PARSE_EXPECT_VALUE);
@@ -352,14 +513,31 @@ private:
             case 'n': return parseLiteral(is, handler, "null", TYPE_NULL);
             case 't': return parseLiteral(is, handler, "true", TYPE_BOOL);
             case 'f': return parseLiteral(is, handler, "false", TYPE_BOOL);
-            case '"': return parseString(is, handler, false);
-            case '[': return parseArray(is, handler);
-            case '{': return parseObject(is, handler);
+            case '"': return parseString(is, handler, false, buffer);
+            case '[': return parseArray(is, handler, buffer);
+            case '{': return parseObject(is, handler, buffer);
             default:  return parseNumber(is, handler);
         }
     }
 
 private:
+    struct StructuralTable
+    {
+        constexpr StructuralTable(): is()
+        {
+            for (char ch: { '"', ',', '[', ']', '{', '}' })
+                is[static_cast<unsigned char>(ch)] = true;
+        }
+        bool is[256];
+    };
+
+    static bool isStructural(char ch)
+    {
+        static constexpr StructuralTable table;
+        return table.is[static_cast<unsigned char>(ch)];
+    }
+    static bool isDelimiter(char ch)
+    { return isStructural(ch) || ch == ':' || ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n'; }
     static bool isDigit(char ch)
     { return ch >= '0' && ch <= '9'; }
     static bool isDigit19(char ch)
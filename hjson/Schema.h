@@ -0,0 +1,511 @@
+#ifndef TJSON_SCHEMA_H
+#define TJSON_SCHEMA_H
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <hjson/Value.h>
+
+namespace json
+{
+
+#define SCHEMA_ERROR_MAP(XX) \
+  XX(OK, "ok") \
+  XX(TYPE, "type not allowed") \
+  XX(REQUIRED, "required property missing") \
+  XX(ENUM, "value not in enum") \
+  XX(MINIMUM, "number below minimum") \
+  XX(MAXIMUM, "number above maximum") \
+  XX(MIN_LENGTH, "string too short") \
+  XX(MAX_LENGTH, "string too long") \
+  XX(MIN_ITEMS, "too few items") \
+  XX(MAX_ITEMS, "too many items")
+
+enum SchemaError {
+#define GEN_ERRNO(e, s) SCHEMA_##e,
+    SCHEMA_ERROR_MAP(GEN_ERRNO)
+#undef GEN_ERRNO
+};
+
+inline const char* schemaErrorStr(SchemaError err)
+{
+    const static char* tab[] = {
+#define GEN_STRERR(e, n) n,
+            SCHEMA_ERROR_MAP(GEN_STRERR)
+#undef GEN_STRERR
+    };
+    assert(err >= 0 && err < sizeof(tab) / sizeof(tab[0]));
+    return tab[err];
+}
+
+#undef SCHEMA_ERROR_MAP
+
+//
+// JSON Schema subset compiled from a parsed schema document: type,
+// required, properties, items (one schema for every element), enum of
+// scalars, minimum/maximum, minLength/maxLength (in code points) and
+// minItems/maxItems. Other keywords are ignored, as the spec says for
+// unknown ones
+//
+class Schema
+{
+public:
+    enum TypeBits {
+        T_NULL    = 1 << 0,
+        T_BOOLEAN = 1 << 1,
+        T_INTEGER = 1 << 2,
+        T_NUMBER  = 1 << 3,
+        T_STRING  = 1 << 4,
+        T_ARRAY   = 1 << 5,
+        T_OBJECT  = 1 << 6,
+    };
+
+    struct Node
+    {
+        unsigned types = 0; // 0: any type
+
+        // at most 64 required names, one bit each while validating
+        std::vector<std::string> required;
+        std::vector<std::pair<std::string, uint32_t>> properties;
+        detail::MemberIndex propertyIndex;
+        uint32_t items = kNone;
+        std::vector<Value> enumValues;
+        bool hasEnum = false;
+
+        bool hasMinimum = false;
+        bool hasMaximum = false;
+        double minimum = 0;
+        double maximum = 0;
+        size_t minLength = 0;
+        size_t maxLength = SIZE_MAX;
+        size_t minItems = 0;
+        size_t maxItems = SIZE_MAX;
+    };
+
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    explicit Schema(const Value& schema)
+    {
+        valid_ = compile(schema) != kNone;
+        if (!valid_)
+            nodes_.clear();
+    }
+
+    bool isValid() const
+    { return valid_; }
+
+    const Node* root() const
+    { return valid_ ? &nodes_[0] : nullptr; }
+
+    // schema of a property, nullptr when the name is not listed
+    const Node* property(const Node& node, std::string_view name) const
+    {
+        auto& properties = node.properties;
+        if (!node.propertyIndex.empty()) {
+            uint32_t pos = node.propertyIndex.find(name, [&properties](uint32_t i) {
+                return std::string_view(properties[i].first);
+            });
+            return pos == detail::MemberIndex::npos ? nullptr : &nodes_[properties[pos].second];
+        }
+        for (auto& property: properties) {
+            if (property.first == name)
+                return &nodes_[property.second];
+        }
+        return nullptr;
+    }
+
+    const Node* items(const Node& node) const
+    { return node.items == kNone ? nullptr : &nodes_[node.items]; }
+
+private:
+    static constexpr size_t kIndexThreshold = 16;
+
+    uint32_t compile(const Value& schema);
+    static bool compileType(std::string_view name, unsigned& types);
+    static bool toSize(const Value& value, size_t& size);
+
+private:
+    std::vector<Node> nodes_;
+    bool valid_;
+};
+
+//
+// Handler adapter checking every event against a Schema before passing it
+// on, e.g. Reader -> SchemaValidator -> Document. The first violation
+// stops the parse (PARSE_USER_STOPPED) before the rest is read, error()
+// and errorPointer() tell what and where
+//
+template <typename Handler>
+class SchemaValidator: noncopyable
+{
+public:
+    SchemaValidator(const Schema& schema, Handler& handler):
+            schema_(schema),
+            handler_(handler)
+    { assert(schema.isValid()); }
+
+    SchemaError error() const
+    { return error_; }
+
+    // JSON Pointer to the offending value
+    std::string errorPointer() const
+    { return pointer_; }
+
+public: // handler
+    bool Null()
+    {
+        auto node = start(Schema::T_NULL);
+        if (node != nullptr && node->hasEnum && !inEnum(*node, [](const Value& v) { return v.isNull(); }))
+            return fail(SCHEMA_ENUM);
+        return ok() && handler_.Null();
+    }
+    bool Bool(bool b)
+    {
+        auto node = start(Schema::T_BOOLEAN);
+        if (node != nullptr && node->hasEnum &&
+            !inEnum(*node, [b](const Value& v) { return v.isBool() && v.getBool() == b; }))
+            return fail(SCHEMA_ENUM);
+        return ok() && handler_.Bool(b);
+    }
+    bool Int32(int32_t i32)
+    { return integer(i32) && handler_.Int32(i32); }
+    bool Int64(int64_t i64)
+    { return integer(i64) && handler_.Int64(i64); }
+    bool Double(double d)
+    {
+        bool integral = std::isfinite(d) && d == std::floor(d);
+        auto node = start(integral ? Schema::T_INTEGER : Schema::T_NUMBER);
+        if (node != nullptr && !number(*node, d))
+            return false;
+        return ok() && handler_.Double(d);
+    }
+    bool String(std::string_view s)
+    {
+        auto node = start(Schema::T_STRING);
+        if (node != nullptr) {
+            if (node->minLength > 0 || node->maxLength != SIZE_MAX) {
+                size_t length = codePoints(s);
+                if (length < node->minLength)
+                    return fail(SCHEMA_MIN_LENGTH);
+                if (length > node->maxLength)
+                    return fail(SCHEMA_MAX_LENGTH);
+            }
+            if (node->hasEnum &&
+                !inEnum(*node, [s](const Value& v) { return v.isString() && v.getStringView() == s; }))
+                return fail(SCHEMA_ENUM);
+        }
+        return ok() && handler_.String(s);
+    }
+    bool Key(std::string_view s)
+    {
+        auto& top = frames_[depth_ - 1];
+        top.key.assign(s.data(), s.size());
+        top.next = nullptr;
+        if (top.node != nullptr) {
+            top.next = schema_.property(*top.node, s);
+            auto& required = top.node->required;
+            for (size_t i = 0; i < required.size(); i++) {
+                if (required[i] == s)
+                    top.seen |= uint64_t(1) << i;
+            }
+        }
+        return handler_.Key(s);
+    }
+    bool StartObject()
+    {
+        auto node = start(Schema::T_OBJECT);
+        if (!ok())
+            return false;
+        push(node, false);
+        return handler_.StartObject();
+    }
+    bool EndObject()
+    {
+        auto& top = frames_[depth_ - 1];
+        if (top.node != nullptr) {
+            size_t count = top.node->required.size();
+            uint64_t all = count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+            if (top.seen != all)
+                return fail(SCHEMA_REQUIRED, depth_ - 1);
+        }
+        depth_--;
+        return handler_.EndObject();
+    }
+    bool StartArray()
+    {
+        auto node = start(Schema::T_ARRAY);
+        if (!ok())
+            return false;
+        push(node, true);
+        return handler_.StartArray();
+    }
+    bool EndArray()
+    {
+        auto& top = frames_[depth_ - 1];
+        if (top.node != nullptr && top.count < top.node->minItems)
+            return fail(SCHEMA_MIN_ITEMS, depth_ - 1);
+        depth_--;
+        return handler_.EndArray();
+    }
+
+private:
+    struct Frame
+    {
+        const Schema::Node* node; // nullptr: anything goes
+        bool isArray;
+        size_t count;
+        uint64_t seen;             // required members present
+        const Schema::Node* next;  // schema of the member after key
+        std::string key;           // last key, for errorPointer()
+    };
+
+    // schema of the value that starts now, checked against its type
+    const Schema::Node* start(unsigned type)
+    {
+        const Schema::Node* node;
+        if (depth_ == 0)
+            node = schema_.root();
+        else {
+            auto& top = frames_[depth_ - 1];
+            if (top.isArray) {
+                top.count++;
+                if (top.node != nullptr && top.count > top.node->maxItems) {
+                    fail(SCHEMA_MAX_ITEMS);
+                    return nullptr;
+                }
+                node = top.node == nullptr ? nullptr : schema_.items(*top.node);
+            }
+            else
+                node = top.next;
+        }
+        if (node == nullptr || node->types == 0)
+            return node;
+        // integers are numbers too
+        unsigned accepted = type == Schema::T_INTEGER ? Schema::T_INTEGER | Schema::T_NUMBER : type;
+        if ((node->types & accepted) == 0) {
+            fail(SCHEMA_TYPE);
+            return nullptr;
+        }
+        return node;
+    }
+
+    void push(const Schema::Node* node, bool isArray)
+    {
+        if (frames_.size() == depth_)
+            frames_.emplace_back();
+        auto& frame = frames_[depth_++];
+        frame.node = node;
+        frame.isArray = isArray;
+        frame.count = 0;
+        frame.seen = 0;
+        frame.next = nullptr;
+    }
+
+    bool integer(int64_t i64)
+    {
+        auto node = start(Schema::T_INTEGER);
+        return node == nullptr ? ok() : number(*node, static_cast<double>(i64));
+    }
+
+    bool number(const Schema::Node& node, double d)
+    {
+        if (node.hasMinimum && d < node.minimum)
+            return fail(SCHEMA_MINIMUM);
+        if (node.hasMaximum && d > node.maximum)
+            return fail(SCHEMA_MAXIMUM);
+        if (node.hasEnum && !inEnum(node, [d](const Value& v) {
+            return (v.isInt64() && static_cast<double>(v.getInt64()) == d) ||
+                   (v.isDouble() && v.getDouble() == d);
+        }))
+            return fail(SCHEMA_ENUM);
+        return true;
+    }
+
+    template <typename Match>
+    static bool inEnum(const Schema::Node& node, Match match)
+    {
+        for (auto& value: node.enumValues) {
+            if (match(value))
+                return true;
+        }
+        return false;
+    }
+
+    static size_t codePoints(std::string_view s)
+    {
+        size_t n = 0;
+        for (char ch: s)
+            n += (static_cast<unsigned char>(ch) & 0xC0) != 0x80;
+        return n;
+    }
+
+    bool ok() const
+    { return error_ == SCHEMA_OK; }
+
+    bool fail(SchemaError err)
+    { return fail(err, depth_); }
+
+    // the offending value is inside the first 'depth' open containers
+    bool fail(SchemaError err, size_t depth)
+    {
+        if (error_ != SCHEMA_OK)
+            return false;
+        error_ = err;
+        for (size_t i = 0; i < depth; i++) {
+            auto& frame = frames_[i];
+            pointer_.push_back('/');
+            if (frame.isArray)
+                pointer_ += std::to_string(frame.count - 1);
+            else {
+                for (char ch: frame.key) {
+                    if (ch == '~')
+                        pointer_ += "~0";
+                    else if (ch == '/')
+                        pointer_ += "~1";
+                    else
+                        pointer_.push_back(ch);
+                }
+            }
+        }
+        return false;
+    }
+
+private:
+    const Schema& schema_;
+    Handler& handler_;
+    // frames_[0, depth_) are open, the rest keep their buffers
+    std::vector<Frame> frames_;
+    size_t depth_ = 0;
+    SchemaError error_ = SCHEMA_OK;
+    std::string pointer_;
+};
+
+inline uint32_t Schema::compile(const Value& schema)
+{
+    if (!schema.isObject())
+        return kNone;
+
+    auto index = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+
+    for (auto& member: schema.getObject()) {
+        auto key = member.key.getStringView();
+        auto& value = member.value;
+
+        if (key == "type") {
+            unsigned types = 0;
+            if (value.isString()) {
+                if (!compileType(value.getStringView(), types))
+                    return kNone;
+            }
+            else if (value.isArray()) {
+                for (auto& type: value.getArray()) {
+                    if (!type.isString() || !compileType(type.getStringView(), types))
+                        return kNone;
+                }
+            }
+            else
+                return kNone;
+            nodes_[index].types = types;
+        }
+        else if (key == "required") {
+            if (!value.isArray() || value.getSize() > 64)
+                return kNone;
+            for (auto& name: value.getArray()) {
+                if (!name.isString())
+                    return kNone;
+                nodes_[index].required.push_back(name.getString());
+            }
+        }
+        else if (key == "properties") {
+            if (!value.isObject())
+                return kNone;
+            for (auto& property: value.getObject()) {
+                uint32_t child = compile(property.value);
+                if (child == kNone)
+                    return kNone;
+                nodes_[index].properties.emplace_back(property.key.getString(), child);
+            }
+        }
+        else if (key == "items") {
+            uint32_t child = compile(value);
+            if (child == kNone)
+                return kNone;
+            nodes_[index].items = child;
+        }
+        else if (key == "enum") {
+            if (!value.isArray())
+                return kNone;
+            for (auto& option: value.getArray()) {
+                if (option.isArray() || option.isObject())
+                    return kNone; // scalars only
+                nodes_[index].enumValues.push_back(option);
+            }
+            nodes_[index].hasEnum = true;
+        }
+        else if (key == "minimum" || key == "maximum") {
+            if (!value.isInt64() && !value.isDouble())
+                return kNone;
+            double d = value.isDouble() ? value.getDouble() : static_cast<double>(value.getInt64());
+            auto& node = nodes_[index];
+            (key == "minimum" ? node.hasMinimum : node.hasMaximum) = true;
+            (key == "minimum" ? node.minimum : node.maximum) = d;
+        }
+        else if (key == "minLength" || key == "maxLength" ||
+                 key == "minItems" || key == "maxItems") {
+            size_t size;
+            if (!toSize(value, size))
+                return kNone;
+            auto& node = nodes_[index];
+            if (key == "minLength")
+                node.minLength = size;
+            else if (key == "maxLength")
+                node.maxLength = size;
+            else if (key == "minItems")
+                node.minItems = size;
+            else
+                node.maxItems = size;
+        }
+    }
+
+    auto& node = nodes_[index];
+    if (node.properties.size() >= kIndexThreshold) {
+        auto& properties = node.properties;
+        node.propertyIndex.build(properties.size(), [&properties](size_t i) {
+            return std::string_view(properties[i].first);
+        });
+    }
+    return index;
+}
+
+inline bool Schema::compileType(std::string_view name, unsigned& types)
+{
+    static const std::pair<std::string_view, unsigned> names[] = {
+            { "null", T_NULL }, { "boolean", T_BOOLEAN }, { "integer", T_INTEGER },
+            { "number", T_NUMBER }, { "string", T_STRING }, { "array", T_ARRAY },
+            { "object", T_OBJECT },
+    };
+    for (auto& entry: names) {
+        if (entry.first == name) {
+            types |= entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool Schema::toSize(const Value& value, size_t& size)
+{
+    if (!value.isInt64() || value.getInt64() < 0)
+        return false;
+    size = static_cast<size_t>(value.getInt64());
+    return true;
+}
+
+}
+
+#endif //TJSON_SCHEMA_H
@@ -0,0 +1,191 @@
+#ifndef TJSON_SHAREDDOCUMENT_H
+#define TJSON_SHAREDDOCUMENT_H
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <hjson/noncopyable.h>
+
+namespace json
+{
+
+//
+// Read-mostly holder of an immutable T (usually a Document), swapped as a
+// whole by publish(). Readers pin() the current snapshot through a hazard
+// pointer: a slot on its own cache line, picked from a per-thread hint, so
+// pinning writes nothing shared and the nodes of T are read through const
+// references without touching their reference counts (copying a Value out
+// of a snapshot does, keep references where it matters).
+//
+// publish() retires the previous snapshot, it is deleted by the first
+// publish() after the last reader that pinned it lets go. With more than
+// kSlots snapshots pinned at once pin() waits for a free slot
+//
+template <typename T, size_t kSlots = 128>
+class SharedDocument: noncopyable
+{
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<const T*> hazard{ nullptr };
+        std::atomic<bool> busy{ false };
+    };
+
+public:
+    class Snapshot
+    {
+    public:
+        Snapshot(Snapshot&& rhs) noexcept:
+                value_(rhs.value_),
+                slot_(rhs.slot_)
+        { rhs.slot_ = nullptr; }
+
+        Snapshot& operator=(Snapshot&& rhs) noexcept
+        {
+            if (this != &rhs) {
+                release();
+                value_ = rhs.value_;
+                slot_ = rhs.slot_;
+                rhs.slot_ = nullptr;
+            }
+            return *this;
+        }
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        ~Snapshot()
+        { release(); }
+
+        // nullptr before the first publish()
+        const T* get() const
+        { return value_; }
+        const T& operator*() const
+        { return *value_; }
+        const T* operator->() const
+        { return value_; }
+        explicit operator bool() const
+        { return value_ != nullptr; }
+
+    private:
+        friend class SharedDocument;
+
+        Snapshot(const T* value, Slot* slot):
+                value_(value),
+                slot_(slot)
+        {}
+
+        void release()
+        {
+            if (slot_ != nullptr) {
+                slot_->hazard.store(nullptr, std::memory_order_release);
+                slot_->busy.store(false, std::memory_order_release);
+                slot_ = nullptr;
+            }
+        }
+
+        const T* value_;
+        Slot* slot_;
+    };
+
+    SharedDocument():
+            slots_(new Slot[kSlots])
+    {}
+
+    explicit SharedDocument(std::unique_ptr<T> value):
+            SharedDocument()
+    { current_.store(value.release()); }
+
+    ~SharedDocument()
+    {
+        delete current_.load();
+        for (const T* retired: retired_)
+            delete retired;
+    }
+
+    Snapshot pin() const
+    {
+        Slot* slot = acquire();
+        const T* value = current_.load();
+        while (true) {
+            slot->hazard.store(value);
+            // the hazard is visible before publish() could have retired it
+            const T* again = current_.load();
+            if (again == value)
+                return Snapshot(value, slot);
+            value = again;
+        }
+    }
+
+    // the new snapshot is seen by every pin() that starts afterwards
+    void publish(std::unique_ptr<T> value)
+    {
+        const T* old = current_.exchange(value.release());
+        std::lock_guard lock(mutex_);
+        if (old != nullptr)
+            retired_.push_back(old);
+        reclaim();
+    }
+
+    // retired snapshots still pinned by a reader
+    size_t retiredCount() const
+    {
+        std::lock_guard lock(mutex_);
+        return retired_.size();
+    }
+
+private:
+    Slot* acquire() const
+    {
+        thread_local size_t hint = std::hash<std::thread::id>()(std::this_thread::get_id());
+        for (size_t i = hint % kSlots; ; i = (i + 1) % kSlots) {
+            Slot& slot = slots_[i];
+            if (!slot.busy.load(std::memory_order_relaxed) &&
+                !slot.busy.exchange(true, std::memory_order_acquire)) {
+                hint = i;
+                return &slot;
+            }
+            if ((i + 1) % kSlots == hint % kSlots)
+                std::this_thread::yield();
+        }
+    }
+
+    // with mutex_ held
+    void reclaim()
+    {
+        hazards_.clear();
+        for (size_t i = 0; i < kSlots; i++) {
+            const T* hazard = slots_[i].hazard.load();
+            if (hazard != nullptr)
+                hazards_.push_back(hazard);
+        }
+        size_t kept = 0;
+        for (const T* retired: retired_) {
+            bool pinned = false;
+            for (const T* hazard: hazards_)
+                pinned |= hazard == retired;
+            if (pinned)
+                retired_[kept++] = retired;
+            else
+                delete retired;
+        }
+        retired_.resize(kept);
+    }
+
+private:
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<const T*> current_{ nullptr };
+    mutable std::mutex mutex_;
+    std::vector<const T*> retired_;
+    std::vector<const T*> hazards_;
+};
+
+}
+
+#endif //TJSON_SHAREDDOCUMENT_H
@@ -20,6 +20,15 @@ public:
     {
         buffer_.insert(buffer_.end(), str.begin(), str.end());
     }
+    // room for size bytes in all, so writing up to there never reallocates
+    void reserve(size_t size)
+    {
+        buffer_.reserve(size);
+    }
+    size_t size() const
+    {
+        return buffer_.size();
+    }
     std::string_view get() const
     {
         return std::string_view(&*buffer_.begin(), buffer_.size());
@@ -2,13 +2,24 @@
 #define TJSON_VALUE_H
 
 #include <cassert>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <string_view>
 #include <vector>
 #include <algorithm>
 #include <atomic>
-
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <unordered_set>
+
+#include <hjson/Format.h>
 #include <hjson/noncopyable.h>
 
 namespace json
@@ -16,6 +27,106 @@ namespace json
 
 using namespace std::string_view_literals;
 
+namespace detail
+{
+
+// handlers taking numbers as source text, e.g. Writer
+template <typename Handler, typename = void>
+struct HasRawNumber: std::false_type {};
+
+template <typename Handler>
+struct HasRawNumber<Handler, std::void_t<decltype(std::declval<Handler&>().RawNumber(std::string_view()))>>:
+        std::true_type {};
+
+// 64-bit finalizer from splitmix64
+inline uint64_t mixHash(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+//
+// open-addressing index from member key to member position,
+// each slot packs the high half of the key hash and (position + 1),
+// 0 marks an empty slot
+//
+class MemberIndex
+{
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    bool empty() const
+    { return slots_.empty(); }
+
+    size_t capacity() const
+    { return slots_.capacity(); }
+
+    void clear()
+    { slots_.clear(); }
+
+    // keyAt(i) returns the key of member i, for i in [0, size)
+    template <typename KeyAt>
+    void build(size_t size, KeyAt keyAt)
+    {
+        size_t capacity = 16;
+        while (capacity < size * 2)
+            capacity *= 2;
+        slots_.assign(capacity, 0);
+        for (size_t i = 0; i < size; i++)
+            place(hash(keyAt(i)), static_cast<uint32_t>(i));
+    }
+
+    // member 'pos' was appended, size is the new member count
+    template <typename KeyAt>
+    void insert(size_t pos, size_t size, KeyAt keyAt)
+    {
+        if (size * 2 > slots_.size())
+            build(size, keyAt);
+        else
+            place(hash(keyAt(pos)), static_cast<uint32_t>(pos));
+    }
+
+    template <typename KeyAt>
+    uint32_t find(std::string_view key, KeyAt keyAt) const
+    {
+        size_t h = hash(key);
+        size_t mask = slots_.size() - 1;
+        for (size_t i = h & mask; ; i = (i + 1) & mask) {
+            uint64_t slot = slots_[i];
+            if (slot == 0)
+                return npos;
+            auto pos = static_cast<uint32_t>(slot) - 1;
+            if ((slot >> 32) == tag(h) && keyAt(pos) == key)
+                return pos;
+        }
+    }
+
+private:
+    static size_t hash(std::string_view key)
+    { return std::hash<std::string_view>()(key); }
+
+    static uint64_t tag(size_t h)
+    { return static_cast<uint64_t>(h) >> 32; }
+
+    void place(size_t h, uint32_t pos)
+    {
+        size_t mask = slots_.size() - 1;
+        size_t i = h & mask;
+        while (slots_[i] != 0)
+            i = (i + 1) & mask;
+        slots_[i] = (tag(h) << 32) | (static_cast<uint64_t>(pos) + 1);
+    }
+
+private:
+    std::vector<uint64_t> slots_;
+};
+
+}
+
 enum ValueType {
     TYPE_NULL,
     TYPE_BOOL,
@@ -27,14 +138,73 @@ enum ValueType {
     TYPE_OBJECT,
 };
 
+//
+// element type of a packed array: a homogeneous numeric array stored as
+// a plain buffer of numbers instead of one Value per element
+//
+enum PackedType {
+    PACKED_NONE,
+    PACKED_INT32,
+    PACKED_INT64,
+    PACKED_DOUBLE,
+    PACKED_FLOAT, // lossy, from doubles
+};
+
+// contiguous read-only numbers of a packed array
+template <typename T>
+class PackedView
+{
+public:
+    PackedView() = default;
+    PackedView(const T* data, size_t size):
+            data_(data), size_(size)
+    {}
+
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+
+    const T& operator[] (size_t i) const
+    {
+        assert(i < size_);
+        return data_[i];
+    }
+
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
 struct Member;
 class Document;
 
+//
+// heap bytes held by a tree of values, a node shared by several values
+// is counted once. Slack (reserved but unused capacity) is included in
+// the per-type numbers and also reported on its own
+//
+struct MemoryStats
+{
+    size_t stringBytes = 0;
+    size_t arrayBytes  = 0;
+    size_t objectBytes = 0;
+    size_t numberBytes = 0; // text kept for lazy numbers
+    size_t slackBytes  = 0;
+    size_t totalBytes  = 0;
+
+    size_t nodeCount[TYPE_OBJECT + 1] = {}; // distinct values by ValueType
+    size_t sharedNodes = 0;                 // nodes with more than one owner, keys aside
+    size_t maxDepth    = 0;                 // deepest array/object nesting
+};
+
 class Value
 {
     friend class Document;
 public:
-    typedef std::vector<Member>::iterator       MemberIterator;
+    class MemberIterator;
     typedef std::vector<Member>::const_iterator ConstMemberIterator;
 
 public:
@@ -74,11 +244,18 @@ public:
             Value(std::string_view(s, len))
     {}
 
+    //
+    // a copy shares the string, array and object nodes until either side
+    // mutates (copy-on-write). References into a value, from operator[],
+    // getMemberValue() or member iterators, are invalidated by copying it:
+    // mutating through one taken before the copy reaches the shared node
+    // and changes the copy too. Take them again after copying
+    //
     Value(const Value& rhs);
-    Value(Value&& rhs);
+    Value(Value&& rhs) noexcept;
 
     Value& operator=(const Value& rhs);
-    Value& operator=(Value&& rhs);
+    Value& operator=(Value&& rhs) noexcept;
 
     ~Value();
 
@@ -113,10 +290,21 @@ public:
         return type_ == TYPE_INT64 ? i64_ : i32_;
     }
 
+    // a lazy number is converted on the first call
     double getDouble() const
     {
         assert(type_ == TYPE_DOUBLE);
-        return d_;
+        return aux_ == 0 ? d_ : lazyDouble();
+    }
+
+    // source text of a lazy number (see FLAG_LAZY_NUMBERS), empty for
+    // any other value
+    std::string_view getRawNumber() const
+    {
+        if (type_ != TYPE_DOUBLE || aux_ == 0)
+            return std::string_view();
+        auto entry = rawEntry();
+        return std::string_view(entry + kRawText, static_cast<uint8_t>(entry[kRawLength]));
     }
 
     std::string_view getStringView() const
@@ -130,9 +318,11 @@ public:
         return std::string(getStringView());
     }
 
+    // a packed array builds its Values on the first call
     const auto& getArray() const
     {
         assert(type_ == TYPE_ARRAY);
+        unpack();
         return a_->data;
     }
 
@@ -193,32 +383,31 @@ public:
     Value& operator[] (std::string_view key);
     const Value& operator[] (std::string_view key) const;
 
-    MemberIterator memberBegin()
+    // mutable iterators give const keys, so the hash index stays valid
+    MemberIterator memberBegin();
+
+    ConstMemberIterator memberBegin() const
     {
         assert(type_ == TYPE_OBJECT);
         return o_->data.begin();
     }
 
-    ConstMemberIterator memberBegin() const
-    {
-        return const_cast<Value&>(*this).memberBegin();
-    }
+    MemberIterator memberEnd();
 
-    MemberIterator memberEnd()
+    ConstMemberIterator memberEnd() const
     {
         assert(type_ == TYPE_OBJECT);
         return o_->data.end();
     }
 
-    ConstMemberIterator memberEnd() const
-    {
-        return const_cast<Value&>(*this).memberEnd();
-    }
-
     MemberIterator findMember(std::string_view key);
 
     ConstMemberIterator findMember(std::string_view key) const;
 
+    Value& getMemberValue(size_t i);
+
+    const Value& getMemberValue(size_t i) const;
+
     template <typename V>
     Value& addMember(const char* key, V&& value)
     {
@@ -229,31 +418,204 @@ public:
 
     Value& addMember(Value&& key, Value&& value);
 
+    // keeps the order of the remaining members
+    bool removeMember(std::string_view key);
+
     template <typename T>
     Value& addValue(T&& value)
     {
         assert(type_ == TYPE_ARRAY);
+        detach();
         a_->data.emplace_back(std::forward<T>(value));
         return a_->data.back();
     }
 
+    // before position i, i == getSize() appends
+    template <typename T>
+    Value& insertValue(size_t i, T&& value)
+    {
+        assert(type_ == TYPE_ARRAY);
+        assert(i <= a_->data.size());
+        detach();
+        auto pos = a_->data.begin() + static_cast<std::ptrdiff_t>(i);
+        return *a_->data.emplace(pos, std::forward<T>(value));
+    }
+
+    void eraseValue(size_t i)
+    {
+        assert(type_ == TYPE_ARRAY);
+        assert(i < a_->data.size());
+        detach();
+        a_->data.erase(a_->data.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+
     const Value& operator[] (size_t i) const
     {
         assert(type_ == TYPE_ARRAY);
+        unpack();
         return a_->data[i];
     }
 
+    //
+    // packed arrays: pack() turns a non-empty array of only integers or
+    // only doubles into a buffer of numbers (doubles into floats when
+    // lossy). An array of rows, equal-length arrays packed with the same
+    // type, such as [[x, y], ...], is packed into one buffer, row-major.
+    // getArray() and operator[] keep working, they unpack on first use
+    // and may be called from several threads. The views cover every
+    // number and are empty unless the array is packed with their type, a
+    // mutating access ends the packing. Integers come back as int32 when
+    // they fit, like the reader produces them
+    //
+    bool pack(bool lossy = false);
+
+    PackedType getPackedType() const
+    {
+        assert(type_ == TYPE_ARRAY);
+        return static_cast<PackedType>(a_->packedType);
+    }
+
+    // length of the rows of a packed array of rows, 0 otherwise
+    size_t getPackedColumns() const
+    {
+        assert(type_ == TYPE_ARRAY);
+        return a_->packedType == PACKED_NONE ? 0 : a_->packedColumns;
+    }
+
+    PackedView<int32_t> getInt32Array() const
+    { return packedView<int32_t>(PACKED_INT32); }
+    PackedView<int64_t> getInt64Array() const
+    { return packedView<int64_t>(PACKED_INT64); }
+    PackedView<double> getDoubleArray() const
+    { return packedView<double>(PACKED_DOUBLE); }
+    PackedView<float> getFloatArray() const
+    { return packedView<float>(PACKED_FLOAT); }
+
     Value& operator[] (size_t i)
     {
         assert(type_ == TYPE_ARRAY);
+        detach();
         return a_->data[i];
     }
 
     template <typename Handler>
     bool writeTo(Handler& handler) const;
 
+    //
+    // structural hash, equal values hash the same: object members in any
+    // order, int32 and int64 by value. Shared strings, arrays and objects
+    // cache it on their node, copy-on-write keeps those from changing
+    //
+    size_t hash() const
+    { return computeHash(false); }
+
+    //
+    // length of the text Writer puts for this value (compact, lazy numbers
+    // as their source text), known before writing: a Content-Length, or an
+    // output buffer sized once. A walk of the tree without the writing,
+    // not cached: a field for it would grow every array and object node
+    //
+    size_t serializedSize() const;
+
+    // deep equality with JSON semantics, see hash(). Shared nodes compare
+    // equal, and shared nodes with different cached hashes unequal,
+    // without a walk
+    bool operator==(const Value& rhs) const
+    { return equals(rhs, EQUAL_JSON); }
+
+    bool operator!=(const Value& rhs) const
+    { return !equals(rhs, EQUAL_JSON); }
+
+    // both refer to the same node (or hold the same scalar)
+    bool sameStorage(const Value& rhs) const
+    {
+        if (type_ != rhs.type_)
+            return false;
+        return type_ >= TYPE_STRING ? a_ == rhs.a_ : equals(rhs, EQUAL_ORDERED);
+    }
+
+    // walks the whole tree, only pay for it when asked
+    size_t memoryUsage() const
+    {
+        MemoryStats stats;
+        std::unordered_set<const void*> visited;
+        collectStats(stats, 0, visited);
+        return stats.totalBytes;
+    }
+
 private:
+    enum Equality
+    {
+        EQUAL_JSON,    // operator==
+        EQUAL_ORDERED, // object members also in the same order
+        EQUAL_EXACT,   // ordered, and written the same: same number types,
+                       // doubles bit for bit, lazy numbers by their text
+    };
+
+    bool equals(const Value& rhs, Equality equality) const;
+
+    // keepUnique: also cache on uniquely owned nodes, for a pass that
+    // mutates nothing and drops those afterwards (Document::deduplicate)
+    size_t computeHash(bool keepUnique) const;
+
+    void collectStats(MemoryStats& stats, size_t depth,
+                      std::unordered_set<const void*>& visited) const;
+
+    // copy-on-write: give this value its own array/object node before
+    // mutating it, cheap when the node is already uniquely owned
+    void detach();
+
+    // position of the member, getSize() when absent. Only a lookup that
+    // may build the index is allowed to (see ObjectWithRefCount::index)
+    size_t memberPosition(std::string_view key, bool buildIndex) const;
+
+    //
+    // lazy number: a double kept as its source text in a shared chunk,
+    // aux_ - 1 is the offset of its entry:
+    //
+    //   [converted bits: 8] [converted flag: 1] [length: 1] [text] [\0]
+    //
+    static constexpr size_t kRawConverted = 8;
+    static constexpr size_t kRawLength = 9;
+    static constexpr size_t kRawText = 10;
+
+    const char* rawEntry() const
+    { return n_->data.data() + (aux_ - 1); }
+
+    double lazyDouble() const;
+
+    void unpack() const
+    {
+        if (a_->state.load(std::memory_order_acquire) != ArrayWithRefCount::READY)
+            unpackSlow();
+    }
+    void unpackSlow() const;
+
+    // element i of an array, packed or not
+    Value elementAt(size_t i) const;
+    // number k of a packed array's buffer, rows flattened
+    Value packedScalar(size_t k) const;
+    // elementAt(i).equals(rhs.elementAt(i)) without building packed rows
+    bool elementEquals(const Value& rhs, size_t i, Equality equality) const;
+
+    template <typename T>
+    PackedView<T> packedView(PackedType type) const
+    {
+        assert(type_ == TYPE_ARRAY);
+        if (a_->packedType != type)
+            return PackedView<T>();
+        return PackedView<T>(a_->template packed<T>(), a_->packedCount());
+    }
+
+    template <typename Handler>
+    bool writePacked(Handler& handler) const;
+    template <typename Handler>
+    bool writeNumbers(Handler& handler, size_t begin, size_t count) const;
+    size_t packedTextSize() const;
+
     ValueType type_;
+    // lazy numbers only, fits the padding
+    uint32_t aux_ = 0;
 
     template <typename T>
     struct AddRefCount
@@ -279,12 +641,92 @@ private:
         }
 
         std::atomic_int refCount;
+        // structural hash, 0 when not computed yet (fits the padding).
+        // Only trusted while the node is shared: a uniquely owned node can
+        // change through a reference to one of its children
+        std::atomic<uint32_t> hash{0};
         T data;
     };
 
+    // lookups in objects with at least this many members build a hash index
+    static constexpr size_t kIndexThreshold = 16;
+
+    struct ObjectWithRefCount: AddRefCount<std::vector<Member>>
+    {
+        using AddRefCount<std::vector<Member>>::AddRefCount;
+
+        ~ObjectWithRefCount()
+        { delete index.load(std::memory_order_relaxed); }
+
+        void dropIndex()
+        {
+            if (index.load(std::memory_order_relaxed) != nullptr)
+                delete index.exchange(nullptr, std::memory_order_relaxed);
+        }
+
+        size_t indexBytes() const
+        {
+            auto p = index.load(std::memory_order_relaxed);
+            return p == nullptr ? 0 : sizeof(*p) + p->capacity() * sizeof(uint64_t);
+        }
+
+        // built by the first lookup once there are kIndexThreshold members,
+        // kept up to date by addMember() and dropped by other mutations.
+        // Readers of a shared node may race to build it, the first one to
+        // publish wins
+        std::atomic<detail::MemberIndex*> index{ nullptr };
+    };
+
+    struct ArrayWithRefCount: AddRefCount<std::vector<Value>>
+    {
+        using AddRefCount<std::vector<Value>>::AddRefCount;
+
+        // a packed node is allocated with its numbers right behind it
+        static void* operator new(size_t size)
+        { return ::operator new(size); }
+        static void* operator new(size_t, void* p)
+        { return p; }
+        static void operator delete(void* p)
+        { ::operator delete(p); }
+
+        // nullptr unless values is a non-empty array of only integers,
+        // only doubles or only rows
+        static ArrayWithRefCount* newPacked(const std::vector<Value>& values, bool lossy);
+        static ArrayWithRefCount* newPackedRows(const std::vector<Value>& values);
+        static ArrayWithRefCount* allocatePacked(PackedType type, size_t size, size_t columns);
+
+        static size_t packedWidth(uint8_t type)
+        {
+            static const size_t widths[] = { 0, sizeof(int32_t), sizeof(int64_t),
+                                             sizeof(double), sizeof(float) };
+            return widths[type];
+        }
+
+        // numbers in the buffer
+        size_t packedCount() const
+        { return packedColumns == 0 ? packedSize : size_t(packedSize) * packedColumns; }
+
+        template <typename T>
+        const T* packed() const
+        { return reinterpret_cast<const T*>(this + 1); }
+
+        template <typename T>
+        T* packed()
+        { return reinterpret_cast<T*>(this + 1); }
+
+        // READY: data holds the elements, a packed node fills it on first
+        // access (PACKED -> UNPACKING -> READY)
+        enum: uint8_t { READY, PACKED, UNPACKING };
+
+        uint32_t packedSize = 0;    // elements, rows for an array of rows
+        uint8_t packedType = PACKED_NONE;
+        std::atomic<uint8_t> state{ READY };
+        uint16_t packedColumns = 0; // row length, 0 when not of rows
+    };
+
     typedef AddRefCount<std::vector<char>>   StringWithRefCount;
-    typedef AddRefCount<std::vector<Value>>  ArrayWithRefCount;
-    typedef AddRefCount<std::vector<Member>> ObjectWithRefCount;
+    // texts of lazy numbers, filled by a Document and never resized
+    typedef AddRefCount<std::vector<char>>   ChunkWithRefCount;
 
     union {
         bool     b_;
@@ -292,6 +734,7 @@ private:
         int64_t  i64_;
         double   d_;
         StringWithRefCount*  s_;
+        ChunkWithRefCount*   n_;
         ArrayWithRefCount*   a_;
         ObjectWithRefCount*  o_;
     };
@@ -313,6 +756,64 @@ struct Member
     Value value;
 };
 
+// member seen through a Value::MemberIterator, the key is read-only
+struct MemberRef
+{
+    const Value& key;
+    Value& value;
+};
+
+class Value::MemberIterator
+{
+public:
+    struct Arrow
+    {
+        MemberRef ref;
+        const MemberRef* operator->() const { return &ref; }
+    };
+
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef MemberRef                       value_type;
+    typedef std::ptrdiff_t                  difference_type;
+    typedef MemberRef                       reference;
+    typedef Arrow                           pointer;
+
+    MemberIterator() = default;
+    explicit MemberIterator(std::vector<Member>::iterator it):
+            it_(it)
+    {}
+
+    operator ConstMemberIterator() const
+    { return it_; }
+
+    MemberRef operator*() const
+    { return MemberRef{ it_->key, it_->value }; }
+    Arrow operator->() const
+    { return Arrow{ **this }; }
+    MemberRef operator[](difference_type n) const
+    { return *(*this + n); }
+
+    MemberIterator& operator++() { ++it_; return *this; }
+    MemberIterator& operator--() { --it_; return *this; }
+    MemberIterator operator++(int) { return MemberIterator(it_++); }
+    MemberIterator operator--(int) { return MemberIterator(it_--); }
+    MemberIterator& operator+=(difference_type n) { it_ += n; return *this; }
+    MemberIterator& operator-=(difference_type n) { it_ -= n; return *this; }
+    MemberIterator operator+(difference_type n) const { return MemberIterator(it_ + n); }
+    MemberIterator operator-(difference_type n) const { return MemberIterator(it_ - n); }
+    difference_type operator-(const MemberIterator& rhs) const { return it_ - rhs.it_; }
+
+    bool operator==(const MemberIterator& rhs) const { return it_ == rhs.it_; }
+    bool operator!=(const MemberIterator& rhs) const { return it_ != rhs.it_; }
+    bool operator<(const MemberIterator& rhs) const { return it_ < rhs.it_; }
+    bool operator>(const MemberIterator& rhs) const { return it_ > rhs.it_; }
+    bool operator<=(const MemberIterator& rhs) const { return it_ <= rhs.it_; }
+    bool operator>=(const MemberIterator& rhs) const { return it_ >= rhs.it_; }
+
+private:
+    std::vector<Member>::iterator it_;
+};
+
 
 #define CALL(expr) do { if (!(expr)) return false; } while(false)
 
@@ -334,15 +835,25 @@ inline bool Value::writeTo(Handler& handler) const
             CALL(handler.Int64(i64_));
             break;
         case TYPE_DOUBLE:
-            CALL(handler.Double(d_));
+            if constexpr (detail::HasRawNumber<Handler>::value) {
+                if (aux_ != 0) {
+                    CALL(handler.RawNumber(getRawNumber()));
+                    break;
+                }
+            }
+            CALL(handler.Double(getDouble()));
             break;
         case TYPE_STRING:
             CALL(handler.String(getStringView()));
             break;
         case TYPE_ARRAY:
             CALL(handler.StartArray());
-            for (auto& val: getArray()) {
-                CALL(val.writeTo(handler));
+            if (a_->packedType != PACKED_NONE)
+                CALL(writePacked(handler));
+            else {
+                for (auto& val: getArray()) {
+                    CALL(val.writeTo(handler));
+                }
             }
             CALL(handler.EndArray());
             break;
@@ -360,20 +871,71 @@ inline bool Value::writeTo(Handler& handler) const
     return true;
 }
 
+// straight from the numbers, without unpacking
+template <typename Handler>
+inline bool Value::writePacked(Handler& handler) const
+{
+    size_t columns = a_->packedColumns;
+    if (columns == 0)
+        return writeNumbers(handler, 0, a_->packedSize);
+    for (size_t row = 0; row < a_->packedSize; row++) {
+        CALL(handler.StartArray());
+        CALL(writeNumbers(handler, row * columns, columns));
+        CALL(handler.EndArray());
+    }
+    return true;
+}
+
+template <typename Handler>
+inline bool Value::writeNumbers(Handler& handler, size_t begin, size_t count) const
+{
+    size_t end = begin + count;
+    switch (a_->packedType) {
+        case PACKED_INT32:
+            for (size_t i = begin; i < end; i++)
+                CALL(handler.Int32(a_->packed<int32_t>()[i]));
+            break;
+        case PACKED_INT64:
+            for (size_t i = begin; i < end; i++) {
+                int64_t i64 = a_->packed<int64_t>()[i];
+                if (i64 >= INT32_MIN && i64 <= INT32_MAX)
+                    CALL(handler.Int32(static_cast<int32_t>(i64)));
+                else
+                    CALL(handler.Int64(i64));
+            }
+            break;
+        case PACKED_DOUBLE:
+            for (size_t i = begin; i < end; i++)
+                CALL(handler.Double(a_->packed<double>()[i]));
+            break;
+        case PACKED_FLOAT:
+            for (size_t i = begin; i < end; i++)
+                CALL(handler.Double(static_cast<double>(a_->packed<float>()[i])));
+            break;
+        default:
+            assert(false && "bad packed type");
+    }
+    return true;
+}
+
 #undef CALL
 
 
 
 inline Value::Value(const json::Value& rhs)
         : type_(rhs.type_)
+        , aux_(rhs.aux_)
         , a_(rhs.a_)
 {
     switch (type_) {
         case TYPE_NULL:
         case TYPE_BOOL:
         case TYPE_INT32:
-        case TYPE_INT64:
-        case TYPE_DOUBLE: break;
+        case TYPE_INT64: break;
+        case TYPE_DOUBLE:
+            if (aux_ != 0)
+                n_->incrAndGet();
+            break;
         case TYPE_STRING:
             s_->incrAndGet(); break;
         case TYPE_ARRAY:
@@ -384,11 +946,13 @@ inline Value::Value(const json::Value& rhs)
     }
 }
 
-inline Value::Value(Value&& rhs)
+inline Value::Value(Value&& rhs) noexcept
         : type_(rhs.type_)
+        , aux_(rhs.aux_)
         , a_(rhs.a_)
 {
     rhs.type_ = TYPE_NULL;
+    rhs.aux_ = 0;
     rhs.a_ = nullptr;
 }
 
@@ -397,14 +961,18 @@ inline Value& Value::operator=(const json::Value& rhs)
     assert(this != &rhs);
     this->~Value();
     type_ = rhs.type_;
+    aux_ = rhs.aux_;
     a_ = rhs.a_;
     switch (type_)
     {
         case TYPE_NULL:
         case TYPE_BOOL:
         case TYPE_INT32:
-        case TYPE_INT64:
-        case TYPE_DOUBLE: break;
+        case TYPE_INT64: break;
+        case TYPE_DOUBLE:
+            if (aux_ != 0)
+                n_->incrAndGet();
+            break;
         case TYPE_STRING:
             s_->incrAndGet(); break;
         case TYPE_ARRAY:
@@ -416,13 +984,15 @@ inline Value& Value::operator=(const json::Value& rhs)
     return *this;
 }
 
-inline Value& Value::operator=(Value&& rhs)
+inline Value& Value::operator=(Value&& rhs) noexcept
 {
     assert(this != &rhs);
     this->~Value();
     type_ = rhs.type_;
+    aux_ = rhs.aux_;
     a_ = rhs.a_;
     rhs.type_ = TYPE_NULL;
+    rhs.aux_ = 0;
     rhs.a_ = nullptr;
     return *this;
 }
@@ -450,8 +1020,11 @@ inline Value::~Value()
         case TYPE_NULL:
         case TYPE_BOOL:
         case TYPE_INT32:
-        case TYPE_INT64:
-        case TYPE_DOUBLE: break;
+        case TYPE_INT64: break;
+        case TYPE_DOUBLE:
+            if (aux_ != 0 && n_->decrAndGet() == 0)
+                delete n_;
+            break;
         case TYPE_STRING:
             if (s_->decrAndGet() == 0)
                 delete s_;
@@ -468,13 +1041,50 @@ inline Value::~Value()
     }
 }
 
+inline void Value::detach()
+{
+    // the caller is about to mutate, drop the cached hash
+    switch (type_) {
+        case TYPE_ARRAY:
+            unpack();
+            if (a_->refCount > 1) {
+                auto copy = new ArrayWithRefCount(a_->data);
+                if (a_->decrAndGet() == 0)
+                    delete a_;
+                a_ = copy;
+            }
+            else if (a_->packedType != PACKED_NONE) {
+                // a plain node, the packed one goes with its buffer
+                auto plain = new ArrayWithRefCount(std::move(a_->data));
+                a_->decrAndGet();
+                delete a_;
+                a_ = plain;
+            }
+            else
+                a_->hash.store(0, std::memory_order_relaxed);
+            break;
+        case TYPE_OBJECT:
+            if (o_->refCount > 1) {
+                auto copy = new ObjectWithRefCount(o_->data);
+                if (o_->decrAndGet() == 0)
+                    delete o_;
+                o_ = copy;
+            }
+            else
+                o_->hash.store(0, std::memory_order_relaxed);
+            break;
+        default: break;
+    }
+}
+
 inline Value& Value::operator[] (std::string_view key)
 {
     assert(type_ == TYPE_OBJECT);
 
-    auto it = findMember(key);
-    if (it != o_->data.end())
-        return it->value;
+    detach();
+    size_t pos = memberPosition(key, true);
+    if (pos != o_->data.size())
+        return o_->data[pos].value;
 
     assert(false); // unlike std::map
     static Value fake(TYPE_NULL);
@@ -484,7 +1094,7 @@ inline Value& Value::operator[] (std::string_view key)
 inline size_t Value::getSize() const
 {
     if (type_ == TYPE_ARRAY)
-        return a_->data.size();
+        return a_->packedType != PACKED_NONE ? a_->packedSize : a_->data.size();
     else if (type_ == TYPE_OBJECT)
         return o_->data.size();
     return 1;
@@ -492,20 +1102,85 @@ inline size_t Value::getSize() const
 
 inline const Value&  Value::operator[] (std::string_view key) const
 {
-    return const_cast<Value&>(*this)[key];
+    assert(type_ == TYPE_OBJECT);
+
+    auto it = findMember(key);
+    if (it != o_->data.end())
+        return it->value;
+
+    assert(false); // unlike std::map
+    static const Value fake(TYPE_NULL);
+    return fake;
+}
+
+inline Value& Value::getMemberValue(size_t i)
+{
+    assert(type_ == TYPE_OBJECT);
+    assert(i < o_->data.size());
+    detach();
+    return o_->data[i].value;
+}
+
+inline const Value& Value::getMemberValue(size_t i) const
+{
+    assert(type_ == TYPE_OBJECT);
+    assert(i < o_->data.size());
+    return o_->data[i].value;
+}
+
+inline Value::MemberIterator Value::memberBegin()
+{
+    assert(type_ == TYPE_OBJECT);
+    detach();
+    return MemberIterator(o_->data.begin());
+}
+
+inline Value::MemberIterator Value::memberEnd()
+{
+    assert(type_ == TYPE_OBJECT);
+    detach();
+    return MemberIterator(o_->data.end());
 }
 
 inline Value::MemberIterator Value::findMember(std::string_view key)
 {
     assert(type_ == TYPE_OBJECT);
-    return std::find_if(o_->data.begin(), o_->data.end(), [key](const Member& m)->bool {
-        return m.key.getStringView() == key;
-    });
+    detach();
+    size_t pos = memberPosition(key, true);
+    return MemberIterator(o_->data.begin() + static_cast<std::ptrdiff_t>(pos));
 }
 
 inline Value::ConstMemberIterator Value::findMember(std::string_view key) const
 {
-    return const_cast<Value&>(*this).findMember(key);
+    assert(type_ == TYPE_OBJECT);
+    size_t pos = memberPosition(key, true);
+    return o_->data.cbegin() + static_cast<std::ptrdiff_t>(pos);
+}
+
+inline size_t Value::memberPosition(std::string_view key, bool buildIndex) const
+{
+    auto& members = o_->data;
+    auto found = [&members](uint32_t pos) {
+        return pos == detail::MemberIndex::npos ? members.size() : pos;
+    };
+    auto keyAt = [&members](size_t i) {
+        return members[i].key.getStringView();
+    };
+    auto index = o_->index.load(std::memory_order_acquire);
+    if (index == nullptr && buildIndex && members.size() >= kIndexThreshold) {
+        std::unique_ptr<detail::MemberIndex> built(new detail::MemberIndex);
+        built->build(members.size(), keyAt);
+        if (o_->index.compare_exchange_strong(index, built.get(), std::memory_order_acq_rel))
+            index = built.release();
+    }
+    if (index != nullptr)
+        return found(index->find(key, keyAt));
+
+    for (size_t i = 0; i < members.size(); i++) {
+        if (keyAt(i) == key)
+            return i;
+    }
+    return members.size();
 }
 
 
@@ -513,9 +1188,551 @@ inline Value& Value::addMember(Value&& key, Value&& value)
 {
     assert(type_ == TYPE_OBJECT);
     assert(key.type_ == TYPE_STRING);
-    assert(findMember(key.getStringView()) == memberEnd());
-    o_->data.emplace_back(std::move(key), std::move(value));
-    return o_->data.back().value;
+    detach();
+    assert(memberPosition(key.getStringView(), false) == o_->data.size());
+    auto& members = o_->data;
+    members.emplace_back(std::move(key), std::move(value));
+
+    if (auto index = o_->index.load(std::memory_order_relaxed)) {
+        size_t size = members.size();
+        index->insert(size - 1, size, [&members](size_t i) {
+            return members[i].key.getStringView();
+        });
+    }
+    return members.back().value;
+}
+
+inline size_t Value::computeHash(bool keepUnique) const
+{
+    auto fold = [](uint64_t h) {
+        auto h32 = static_cast<uint32_t>(h ^ (h >> 32));
+        return h32 == 0 ? 1u : h32;
+    };
+    auto cached = [&](auto node, auto compute) -> size_t {
+        bool keep = keepUnique || node->refCount > 1;
+        uint32_t h = keep ? node->hash.load(std::memory_order_relaxed) : 0;
+        if (h == 0) {
+            h = fold(compute());
+            if (keep)
+                node->hash.store(h, std::memory_order_relaxed);
+        }
+        return h;
+    };
+    uint64_t seed = static_cast<uint64_t>(type_) << 56;
+
+    switch (type_) {
+        case TYPE_NULL:
+            return fold(detail::mixHash(seed));
+        case TYPE_BOOL:
+            return fold(detail::mixHash(seed + b_));
+        case TYPE_INT32:
+        case TYPE_INT64:
+            seed = static_cast<uint64_t>(TYPE_INT64) << 56;
+            return fold(detail::mixHash(seed ^ static_cast<uint64_t>(getInt64())));
+        case TYPE_DOUBLE: {
+            double d = getDouble();
+            d = d == 0 ? 0.0 : d; // -0.0 == 0.0
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            return fold(detail::mixHash(seed ^ bits));
+        }
+        case TYPE_STRING:
+            return cached(s_, [&]() -> uint64_t {
+                return detail::mixHash(seed ^ std::hash<std::string_view>()(getStringView()));
+            });
+        case TYPE_ARRAY:
+            return cached(a_, [&]() -> uint64_t {
+                uint64_t h = seed;
+                if (a_->packedColumns > 0) {
+                    // rows hashed in place, as the arrays elementAt() builds
+                    size_t columns = a_->packedColumns;
+                    for (size_t row = 0; row < a_->packedSize; row++) {
+                        uint64_t r = seed;
+                        for (size_t k = row * columns; k < (row + 1) * columns; k++)
+                            r = detail::mixHash(r + packedScalar(k).computeHash(keepUnique));
+                        h = detail::mixHash(h + fold(detail::mixHash(r + columns)));
+                    }
+                }
+                else if (a_->packedType != PACKED_NONE) {
+                    for (size_t i = 0; i < a_->packedSize; i++)
+                        h = detail::mixHash(h + packedScalar(i).computeHash(keepUnique));
+                }
+                else {
+                    for (auto& value: a_->data)
+                        h = detail::mixHash(h + value.computeHash(keepUnique));
+                }
+                return detail::mixHash(h + getSize());
+            });
+        case TYPE_OBJECT:
+            return cached(o_, [&]() -> uint64_t {
+                // commutative sum, member order does not matter
+                uint64_t h = 0;
+                for (auto& member: o_->data)
+                    h += detail::mixHash((member.key.computeHash(keepUnique) << 32) ^
+                                         member.value.computeHash(keepUnique));
+                return detail::mixHash(seed + h + o_->data.size());
+            });
+        default:
+            assert(false && "bad type");
+            return 0;
+    }
+}
+
+inline size_t Value::serializedSize() const
+{
+    // brackets and commas
+    auto punctuation = [](size_t count) {
+        return count == 0 ? 2 : count + 1;
+    };
+
+    switch (type_) {
+        case TYPE_NULL:
+            return 4;
+        case TYPE_BOOL:
+            return b_ ? 4 : 5;
+        case TYPE_INT32:
+            return detail::intSize(i32_);
+        case TYPE_INT64:
+            return detail::intSize(i64_);
+        case TYPE_DOUBLE:
+            return aux_ != 0 ? getRawNumber().size() : detail::doubleSize(d_);
+        case TYPE_STRING:
+            return detail::escapedSize(getStringView());
+        case TYPE_ARRAY: {
+            if (a_->packedType != PACKED_NONE)
+                return packedTextSize();
+            size_t size = punctuation(a_->data.size());
+            for (auto& value: a_->data)
+                size += value.serializedSize();
+            return size;
+        }
+        case TYPE_OBJECT: {
+            // a colon per member
+            size_t size = punctuation(o_->data.size()) + o_->data.size();
+            for (auto& member: o_->data)
+                size += detail::escapedSize(member.key.getStringView()) +
+                        member.value.serializedSize();
+            return size;
+        }
+        default:
+            assert(false && "bad type");
+            return 0;
+    }
+}
+
+// same text as writePacked()
+inline size_t Value::packedTextSize() const
+{
+    size_t count = a_->packedCount();
+    size_t size = 0;
+    switch (a_->packedType) {
+        case PACKED_INT32:
+            for (size_t i = 0; i < count; i++)
+                size += detail::intSize(a_->packed<int32_t>()[i]);
+            break;
+        case PACKED_INT64:
+            for (size_t i = 0; i < count; i++)
+                size += detail::intSize(a_->packed<int64_t>()[i]);
+            break;
+        case PACKED_DOUBLE:
+            for (size_t i = 0; i < count; i++)
+                size += detail::doubleSize(a_->packed<double>()[i]);
+            break;
+        case PACKED_FLOAT:
+            for (size_t i = 0; i < count; i++)
+                size += detail::doubleSize(static_cast<double>(a_->packed<float>()[i]));
+            break;
+        default:
+            assert(false && "bad packed type");
+    }
+    // brackets and commas, of every row too
+    size_t rows = a_->packedSize;
+    size_t columns = a_->packedColumns;
+    if (columns == 0)
+        return size + rows + 1;
+    return size + rows * (columns + 1) + rows + 1;
+}
+
+inline bool Value::equals(const Value& rhs, Equality equality) const
+{
+    if (type_ != rhs.type_)
+        return equality != EQUAL_EXACT &&
+               isInt64() && rhs.isInt64() && getInt64() == rhs.getInt64();
+
+    // cached hashes are only set on shared nodes, which do not change
+    auto hashesDiffer = [](auto lhsNode, auto rhsNode) {
+        if (lhsNode->refCount == 1 || rhsNode->refCount == 1)
+            return false;
+        uint32_t lh = lhsNode->hash.load(std::memory_order_relaxed);
+        uint32_t rh = rhsNode->hash.load(std::memory_order_relaxed);
+        return lh != 0 && rh != 0 && lh != rh;
+    };
+
+    switch (type_) {
+        case TYPE_NULL:
+            return true;
+        case TYPE_BOOL:
+            return b_ == rhs.b_;
+        case TYPE_INT32:
+            return i32_ == rhs.i32_;
+        case TYPE_INT64:
+            return i64_ == rhs.i64_;
+        case TYPE_DOUBLE:
+            if (equality == EQUAL_EXACT) {
+                // -0.0 and 0.0, "1.0" and "1.00" are written differently
+                if (aux_ != 0 || rhs.aux_ != 0)
+                    return aux_ != 0 && rhs.aux_ != 0 && getRawNumber() == rhs.getRawNumber();
+                return memcmp(&d_, &rhs.d_, sizeof(d_)) == 0;
+            }
+            return getDouble() == rhs.getDouble();
+        case TYPE_STRING:
+            if (s_ == rhs.s_)
+                return true;
+            if (hashesDiffer(s_, rhs.s_))
+                return false;
+            return getStringView() == rhs.getStringView();
+        case TYPE_ARRAY: {
+            if (a_ == rhs.a_)
+                return true;
+            if (hashesDiffer(a_, rhs.a_) || getSize() != rhs.getSize())
+                return false;
+            if (a_->packedType != PACKED_NONE || rhs.a_->packedType != PACKED_NONE) {
+                for (size_t i = 0; i < getSize(); i++) {
+                    if (!elementEquals(rhs, i, equality))
+                        return false;
+                }
+                return true;
+            }
+            auto& lhsData = a_->data;
+            auto& rhsData = rhs.a_->data;
+            for (size_t i = 0; i < lhsData.size(); i++) {
+                if (!lhsData[i].equals(rhsData[i], equality))
+                    return false;
+            }
+            return true;
+        }
+        case TYPE_OBJECT: {
+            if (o_ == rhs.o_)
+                return true;
+            if (hashesDiffer(o_, rhs.o_) || o_->data.size() != rhs.o_->data.size())
+                return false;
+            auto& lhsData = o_->data;
+            auto& rhsData = rhs.o_->data;
+            for (size_t i = 0; i < lhsData.size(); i++) {
+                auto& member = lhsData[i];
+                if (equality != EQUAL_JSON) {
+                    if (!member.key.equals(rhsData[i].key, equality) ||
+                        !member.value.equals(rhsData[i].value, equality))
+                        return false;
+                }
+                else {
+                    auto it = rhs.findMember(member.key.getStringView());
+                    if (it == rhsData.end() || !member.value.equals(it->value, equality))
+                        return false;
+                }
+            }
+            return true;
+        }
+        default:
+            assert(false && "bad type");
+            return false;
+    }
+}
+
+inline void Value::collectStats(MemoryStats& stats, size_t depth,
+                                std::unordered_set<const void*>& visited) const
+{
+    // shared nodes are visited once, a node owned by one value can only be
+    // reached through that value
+    auto firstVisit = [&](auto node) {
+        if (node->refCount == 1)
+            return true;
+        if (!visited.insert(node).second)
+            return false;
+        stats.sharedNodes++;
+        return true;
+    };
+
+    switch (type_) {
+        case TYPE_DOUBLE: {
+            // a chunk is counted whole, with the first of its numbers
+            if (aux_ != 0 && visited.insert(n_).second) {
+                size_t bytes = sizeof(*n_) + n_->data.capacity();
+                stats.numberBytes += bytes;
+                stats.totalBytes += bytes;
+            }
+            break;
+        }
+        case TYPE_STRING: {
+            if (!firstVisit(s_))
+                return;
+            size_t bytes = sizeof(*s_) + s_->data.capacity();
+            stats.stringBytes += bytes;
+            stats.totalBytes += bytes;
+            stats.slackBytes += s_->data.capacity() - s_->data.size();
+            break;
+        }
+        case TYPE_ARRAY: {
+            if (!firstVisit(a_))
+                return;
+            auto& data = a_->data;
+            size_t bytes = sizeof(*a_) + data.capacity() * sizeof(Value);
+            if (a_->packedType != PACKED_NONE)
+                bytes += a_->packedCount() * ArrayWithRefCount::packedWidth(a_->packedType);
+            stats.arrayBytes += bytes;
+            stats.totalBytes += bytes;
+            stats.slackBytes += (data.capacity() - data.size()) * sizeof(Value);
+            stats.maxDepth = std::max(stats.maxDepth, depth + (a_->packedColumns > 0 ? 2 : 1));
+            if (a_->packedType != PACKED_NONE) {
+                // the elements, unpacked or not, count as values once
+                ValueType type = a_->packedType == PACKED_INT32 ? TYPE_INT32 :
+                                 a_->packedType == PACKED_INT64 ? TYPE_INT64 : TYPE_DOUBLE;
+                stats.nodeCount[type] += a_->packedCount();
+                if (a_->packedColumns > 0)
+                    stats.nodeCount[TYPE_ARRAY] += a_->packedSize;
+            }
+            else {
+                for (auto& value: data)
+                    value.collectStats(stats, depth + 1, visited);
+            }
+            break;
+        }
+        case TYPE_OBJECT: {
+            if (!firstVisit(o_))
+                return;
+            auto& data = o_->data;
+            size_t bytes = sizeof(*o_) + data.capacity() * sizeof(Member) + o_->indexBytes();
+            stats.objectBytes += bytes;
+            stats.totalBytes += bytes;
+            stats.slackBytes += (data.capacity() - data.size()) * sizeof(Member);
+            stats.maxDepth = std::max(stats.maxDepth, depth + 1);
+            for (auto& member: data) {
+                // keys are accounted as string bytes but are not values,
+                // nor shared nodes when a Document interned them
+                size_t strings = stats.nodeCount[TYPE_STRING];
+                size_t shared = stats.sharedNodes;
+                member.key.collectStats(stats, depth + 1, visited);
+                stats.nodeCount[TYPE_STRING] = strings;
+                stats.sharedNodes = shared;
+                member.value.collectStats(stats, depth + 1, visited);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    stats.nodeCount[type_]++;
+}
+
+inline Value::ArrayWithRefCount* Value::ArrayWithRefCount::allocatePacked(
+        PackedType type, size_t size, size_t columns)
+{
+    size_t count = columns == 0 ? size : size * columns;
+    void* memory = ::operator new(sizeof(ArrayWithRefCount) + count * packedWidth(type));
+    auto node = new (memory) ArrayWithRefCount();
+    node->packedSize = static_cast<uint32_t>(size);
+    node->packedColumns = static_cast<uint16_t>(columns);
+    node->packedType = static_cast<uint8_t>(type);
+    node->state.store(PACKED, std::memory_order_relaxed);
+    return node;
+}
+
+inline Value::ArrayWithRefCount* Value::ArrayWithRefCount::newPacked(
+        const std::vector<Value>& values, bool lossy)
+{
+    if (values.empty() || values.size() > UINT32_MAX)
+        return nullptr;
+    if (values[0].type_ == TYPE_ARRAY)
+        return newPackedRows(values);
+
+    bool integers = true, doubles = true, wide = false;
+    for (auto& value: values) {
+        integers &= value.isInt64();
+        doubles &= value.isDouble();
+        wide |= value.type_ == TYPE_INT64;
+        if (!integers && !doubles)
+            return nullptr;
+    }
+    PackedType type = doubles ? (lossy ? PACKED_FLOAT : PACKED_DOUBLE)
+                              : (wide ? PACKED_INT64 : PACKED_INT32);
+
+    auto node = allocatePacked(type, values.size(), 0);
+    for (size_t i = 0; i < values.size(); i++) {
+        auto& value = values[i];
+        switch (type) {
+            case PACKED_INT32:  node->packed<int32_t>()[i] = value.i32_; break;
+            case PACKED_INT64:  node->packed<int64_t>()[i] = value.getInt64(); break;
+            case PACKED_DOUBLE: node->packed<double>()[i] = value.getDouble(); break;
+            case PACKED_FLOAT:  node->packed<float>()[i] = static_cast<float>(value.getDouble()); break;
+            default: break;
+        }
+    }
+    return node;
+}
+
+inline Value::ArrayWithRefCount* Value::ArrayWithRefCount::newPackedRows(
+        const std::vector<Value>& values)
+{
+    auto first = values[0].a_;
+    uint8_t type = first->packedType;
+    size_t columns = first->packedSize;
+    if (type == PACKED_NONE || first->packedColumns != 0 || columns > UINT16_MAX ||
+        values.size() * columns > UINT32_MAX)
+        return nullptr;
+    for (auto& value: values) {
+        if (value.type_ != TYPE_ARRAY || value.a_->packedType != type ||
+            value.a_->packedColumns != 0 || value.a_->packedSize != columns)
+            return nullptr;
+    }
+
+    auto node = allocatePacked(static_cast<PackedType>(type), values.size(), columns);
+    size_t rowBytes = columns * packedWidth(type);
+    auto out = node->packed<char>();
+    for (auto& value: values) {
+        memcpy(out, value.a_->packed<char>(), rowBytes);
+        out += rowBytes;
+    }
+    return node;
+}
+
+inline bool Value::pack(bool lossy)
+{
+    assert(type_ == TYPE_ARRAY);
+    if (a_->packedType != PACKED_NONE)
+        return true;
+    if (!a_->data.empty() && a_->data[0].isArray()) {
+        // rows first, on a copy when they are shared
+        detach();
+        for (auto& row: a_->data) {
+            if (!row.isArray() || !row.pack(lossy))
+                return false;
+        }
+    }
+    auto packed = ArrayWithRefCount::newPacked(a_->data, lossy);
+    if (packed == nullptr)
+        return false;
+    if (a_->decrAndGet() == 0)
+        delete a_;
+    a_ = packed;
+    return true;
+}
+
+inline Value Value::elementAt(size_t i) const
+{
+    if (a_->packedType == PACKED_NONE)
+        return a_->data[i];
+    if (a_->packedColumns == 0)
+        return packedScalar(i);
+
+    size_t columns = a_->packedColumns;
+    size_t rowBytes = columns * ArrayWithRefCount::packedWidth(a_->packedType);
+    Value row;
+    row.type_ = TYPE_ARRAY;
+    row.a_ = ArrayWithRefCount::allocatePacked(static_cast<PackedType>(a_->packedType), columns, 0);
+    memcpy(row.a_->packed<char>(), a_->packed<char>() + i * rowBytes, rowBytes);
+    return row;
+}
+
+inline Value Value::packedScalar(size_t k) const
+{
+    switch (a_->packedType) {
+        case PACKED_INT32:
+            return Value(a_->packed<int32_t>()[k]);
+        case PACKED_INT64: {
+            int64_t i64 = a_->packed<int64_t>()[k];
+            if (i64 >= INT32_MIN && i64 <= INT32_MAX)
+                return Value(static_cast<int32_t>(i64));
+            return Value(i64);
+        }
+        case PACKED_DOUBLE:
+            return Value(a_->packed<double>()[k]);
+        case PACKED_FLOAT:
+            return Value(static_cast<double>(a_->packed<float>()[k]));
+        default:
+            assert(false && "bad packed type");
+            return Value();
+    }
+}
+
+inline bool Value::elementEquals(const Value& rhs, size_t i, Equality equality) const
+{
+    size_t columns = a_->packedType == PACKED_NONE ? 0 : a_->packedColumns;
+    size_t rhsColumns = rhs.a_->packedType == PACKED_NONE ? 0 : rhs.a_->packedColumns;
+    if (columns == 0 && rhsColumns == 0)
+        return elementAt(i).equals(rhs.elementAt(i), equality);
+    if (columns == 0)
+        return rhs.elementEquals(*this, i, equality);
+
+    size_t first = i * columns;
+    if (rhsColumns > 0) {
+        if (rhsColumns != columns)
+            return false;
+        for (size_t k = first; k < first + columns; k++) {
+            if (!packedScalar(k).equals(rhs.packedScalar(k), equality))
+                return false;
+        }
+        return true;
+    }
+    Value other = rhs.elementAt(i);
+    if (other.type_ != TYPE_ARRAY || other.getSize() != columns)
+        return false;
+    for (size_t c = 0; c < columns; c++) {
+        if (!packedScalar(first + c).equals(other.elementAt(c), equality))
+            return false;
+    }
+    return true;
+}
+
+inline double Value::lazyDouble() const
+{
+    auto entry = const_cast<char*>(rawEntry());
+    auto bits = reinterpret_cast<std::atomic<uint64_t>*>(entry);
+    auto converted = reinterpret_cast<std::atomic<uint8_t>*>(entry + kRawConverted);
+    double d;
+    if (converted->load(std::memory_order_acquire)) {
+        uint64_t u = bits->load(std::memory_order_relaxed);
+        memcpy(&d, &u, sizeof(d));
+        return d;
+    }
+    // racing threads store the same bits
+    d = strtod(entry + kRawText, nullptr);
+    uint64_t u;
+    memcpy(&u, &d, sizeof(u));
+    bits->store(u, std::memory_order_relaxed);
+    converted->store(1, std::memory_order_release);
+    return d;
+}
+
+inline void Value::unpackSlow() const
+{
+    auto node = a_;
+    uint8_t expected = ArrayWithRefCount::PACKED;
+    if (node->state.compare_exchange_strong(expected, ArrayWithRefCount::UNPACKING,
+                                            std::memory_order_acquire)) {
+        node->data.reserve(node->packedSize);
+        for (size_t i = 0; i < node->packedSize; i++)
+            node->data.push_back(elementAt(i));
+        node->state.store(ArrayWithRefCount::READY, std::memory_order_release);
+        return;
+    }
+    // another thread is filling it
+    while (node->state.load(std::memory_order_acquire) != ArrayWithRefCount::READY)
+        std::this_thread::yield();
+}
+
+inline bool Value::removeMember(std::string_view key)
+{
+    assert(type_ == TYPE_OBJECT);
+    detach();
+    auto& members = o_->data;
+    size_t pos = memberPosition(key, false);
+    if (pos == members.size())
+        return false;
+    members.erase(members.begin() + static_cast<std::ptrdiff_t>(pos));
+
+    // positions behind the removed member moved, the next lookup re-indexes
+    o_->dropIndex();
+    return true;
 }
 
 }
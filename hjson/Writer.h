@@ -6,7 +6,9 @@
 #include <vector>
 #include <cassert>
 #include <cmath>
+#include <utility>
 
+#include <hjson/Format.h>
 #include <hjson/Value.h>
 
 namespace json
@@ -15,12 +17,67 @@ namespace json
 namespace detail
 {
 
-//
-// fast int to string conversion
-// buffer is NOT null terminated!!!
-//
-unsigned itoa(int32_t val, char* buf);
-unsigned itoa(int64_t val, char* buf);
+// streams that can reference string storage instead of copying it
+template <typename WriteStream, typename = void>
+struct HasPutRef: std::false_type {};
+
+template <typename WriteStream>
+struct HasPutRef<WriteStream, std::void_t<decltype(std::declval<WriteStream&>().putRef(std::string_view()))>>:
+        std::true_type {};
+
+// streams that can allocate their buffer ahead of time
+template <typename WriteStream, typename = void>
+struct HasReserve: std::false_type {};
+
+template <typename WriteStream>
+struct HasReserve<WriteStream, std::void_t<decltype(std::declval<WriteStream&>().reserve(
+        std::declval<WriteStream&>().size()))>>:
+        std::true_type {};
+
+// streams that lend their memory for writes without bounds checks:
+// claim(n) gives room for n bytes or nullptr, commit(used) keeps used
+template <typename WriteStream, typename = void>
+struct HasClaim: std::false_type {};
+
+template <typename WriteStream>
+struct HasClaim<WriteStream, std::void_t<decltype(std::declval<WriteStream&>().claim(size_t()),
+                                                  std::declval<WriteStream&>().commit(size_t()))>>:
+        std::true_type {};
+
+// stack that keeps the first N elements in place, no heap for shallow use
+template <typename T, size_t N>
+class InlineStack
+{
+public:
+    bool empty() const
+    { return size_ == 0; }
+
+    T& back()
+    { return size_ <= N ? inline_[size_ - 1] : spill_.back(); }
+
+    template <typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        if (size_ < N)
+            inline_[size_] = T(std::forward<Args>(args)...);
+        else
+            spill_.emplace_back(std::forward<Args>(args)...);
+        size_++;
+    }
+
+    void pop_back()
+    {
+        assert(size_ > 0);
+        if (size_ > N)
+            spill_.pop_back();
+        size_--;
+    }
+
+private:
+    T inline_[N] = {};
+    std::vector<T> spill_;
+    size_t size_ = 0;
+};
 
 }
 
@@ -47,77 +104,38 @@ public:
     bool Int32(int32_t i32)
     {
         prefix(TYPE_INT32);
-
-        char buf[11];
-        unsigned cnt = detail::itoa(i32, buf);
-        os_.put(std::string_view(buf, cnt));
+        putFormatted<11>([i32](char* buf) { return detail::itoa(i32, buf); });
         return true;
     }
     bool Int64(int64_t i64)
     {
         prefix(TYPE_INT64);
-
-        char buf[20];
-        unsigned cnt = detail::itoa(i64, buf);
-        os_.put(std::string_view(buf, cnt));
+        putFormatted<20>([i64](char* buf) { return detail::itoa(i64, buf); });
         return true;
     }
     bool Double(double d)
     {
         prefix(TYPE_DOUBLE);
 
-        // fixme: faster conversion please
-        char buf[32];
-
-
-        if (std::isinf(d)) {
-            strcpy(buf, "Infinity");
-        }
-        else if (std::isnan(d)) {
-            strcpy(buf, "NaN");
-        }
-        else {
-
-            int n = sprintf(buf, "%.17g", d);
-
-            // type information loss if ".0" not added
-            // "1.0" -> double 1 -> "1"
-            assert(n > 0 && n < 32);
-            auto it = std::find_if_not(buf, buf + n, isdigit);
-            if (it == buf + n) {
-                strcat(buf, ".0");
-            }
-        }
-
-        os_.put(buf);
+        if (std::isinf(d))
+            os_.put("Infinity");
+        else if (std::isnan(d))
+            os_.put("NaN");
+        else
+            putFormatted<32>([d](char* buf) { return detail::dtoa(d, buf); });
+        return true;
+    }
+    // number text kept from the input, written as is
+    bool RawNumber(std::string_view text)
+    {
+        prefix(TYPE_DOUBLE);
+        os_.put(text);
         return true;
     }
     bool String(std::string_view s)
     {
         prefix(TYPE_STRING);
-        os_.put('"');
-        for (auto c: s) {
-            auto u = static_cast<unsigned>(c);
-            switch (u) {
-                case '\"': os_.put("\\\""); break;
-                case '\b': os_.put("\\b");  break;
-                case '\f': os_.put("\\f");  break;
-                case '\n': os_.put("\\n");  break;
-                case '\r': os_.put("\\r");  break;
-                case '\t': os_.put("\\t");  break;
-                case '\\': os_.put("\\\\"); break;
-                default:
-                    if (u < 0x20) {
-                        char buf[7];
-                        snprintf(buf, 7, "\\u%04X", u);
-                        os_.put(buf);
-                    }
-                    else os_.put(c);
-                    break;
-            }
-        }
-
-        os_.put('"');
+        putEscaped(s);
         return true;
     }
     bool StartObject()
@@ -130,9 +148,14 @@ public:
     bool Key(std::string_view s)
     {
         prefix(TYPE_STRING);
-        os_.put('"');
-        os_.put(s);
-        os_.put('"');
+        putEscaped(s);
+        return true;
+    }
+    // key already quoted and escaped, e.g. from a table built at compile time
+    bool EscapedKey(std::string_view quoted)
+    {
+        prefix(TYPE_STRING);
+        os_.put(quoted);
         return true;
     }
     bool EndObject()
@@ -160,6 +183,64 @@ public:
     }
 
 private:
+    // straight into the stream when it has room for the longest text
+    template <size_t kMaxLength, typename Format>
+    void putFormatted(Format format)
+    {
+        if constexpr (detail::HasClaim<WriteStream>::value) {
+            if (char* p = os_.claim(kMaxLength)) {
+                os_.commit(format(p));
+                return;
+            }
+        }
+        char buf[kMaxLength];
+        unsigned cnt = format(buf);
+        os_.put(std::string_view(buf, cnt));
+    }
+
+    // quoted, clean runs go out in one put(), or putRef() where the
+    // stream has it. A stream with claim() takes the whole string at
+    // once when it has room for the worst case, every byte as \u00XX
+    void putEscaped(std::string_view s)
+    {
+        if constexpr (detail::HasClaim<WriteStream>::value) {
+            if (s.size() <= (SIZE_MAX - 2) / 6) {
+                if (char* p = os_.claim(s.size() * 6 + 2)) {
+                    os_.commit(static_cast<size_t>(detail::escapeTo(s, p) - p));
+                    return;
+                }
+            }
+        }
+        os_.put('"');
+        const char* p = s.data();
+        const char* end = p + s.size();
+        while (true) {
+            const char* q = detail::findEscape(p, end);
+            if (q != p) {
+                std::string_view run(p, static_cast<size_t>(q - p));
+                if constexpr (detail::HasPutRef<WriteStream>::value)
+                    os_.putRef(run);
+                else
+                    os_.put(run);
+            }
+            if (q == end)
+                break;
+            auto ch = static_cast<unsigned char>(*q);
+            char escape = detail::escapeOf(ch);
+            if (escape == 'u') {
+                static const char hex[] = "0123456789ABCDEF";
+                char buf[6] = { '\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xF] };
+                os_.put(std::string_view(buf, sizeof(buf)));
+            }
+            else {
+                char buf[2] = { '\\', escape };
+                os_.put(std::string_view(buf, sizeof(buf)));
+            }
+            p = q + 1;
+        }
+        os_.put('"');
+    }
+
     void prefix(ValueType type)
     {
         if (seeValue_)
@@ -189,143 +270,47 @@ private:
 
 private:
     struct Level {
+        Level() = default;
         explicit Level(bool inArray_):
                 inArray(inArray_), valueCount(0)
         {}
-        bool inArray; // in array or object
-        int valueCount;
+        bool inArray = false; // in array or object
+        int valueCount = 0;
     };
 
 private:
-    std::vector<Level> stack_;
+    // nesting up to 32 levels without a heap allocation
+    detail::InlineStack<Level, 32> stack_;
     WriteStream& os_;
     bool seeValue_;
 };
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wconversion"
-
-inline unsigned countDigits(uint32_t n)
-{
-    const uint32_t powers_of_10[] = {
-            0,
-            10,
-            100,
-            1000,
-            10000,
-            100000,
-            1000000,
-            10000000,
-            100000000,
-            1000000000
-    };
-    //
-    // about magic number:
-    //     http://graphics.stanford.edu/~seander/bithacks.html#IntegerLog10
-    // __builtin_clz is gcc builtin:
-    //     https://en.wikipedia.org/wiki/Bit_Manipulation_Instruction_Sets
-    //     https://gcc.gnu.org/onlinedocs/gcc/Other-Builtins.html
-    //
-    uint32_t t = static_cast<uint32_t>((32 - __builtin_clz(n | 1)) * 1233 >> 12);
-    return t - (n < powers_of_10[t]) + 1;
-}
-
-inline unsigned countDigits(uint64_t n)
-{
-    const uint64_t powers_of_10[] = {
-            0,
-            10,
-            100,
-            1000,
-            10000,
-            100000,
-            1000000,
-            10000000,
-            100000000,
-            1000000000,
-            10000000000,
-            100000000000,
-            1000000000000,
-            10000000000000,
-            100000000000000,
-            1000000000000000,
-            10000000000000000,
-            100000000000000000,
-            1000000000000000000,
-            10000000000000000000U
-    };
-    uint32_t t = (64 - __builtin_clzll(n | 1)) * 1233 >> 12;
-    return t - (n < powers_of_10[t]) + 1;
-}
-
-
-
-template <typename T>
-unsigned itoa_(T val, char* buf)
-{
-    static_assert(std::is_unsigned<T>::value, "must be unsigned integer");
-
-    const char digits[201] =
-            "0001020304050607080910111213141516171819"
-            "2021222324252627282930313233343536373839"
-            "4041424344454647484950515253545556575859"
-            "6061626364656667686970717273747576777879"
-            "8081828384858687888990919293949596979899";
-
-    unsigned count = countDigits(val);
-    unsigned next = count - 1;
-
-    while (val >= 100) {
-        unsigned i = (val % 100) * 2;
-        val /= 100;
-        buf[next] = digits[i + 1];
-        buf[next - 1] = digits[i];
-        next -= 2;
-    }
-
-    /* Handle last 1-2 digits. */
-    if (val < 10) {
-        buf[next] = '0' + val;
-    }
-    else {
-        unsigned i = val * 2;
-        buf[next] = digits[i + 1];
-        buf[next - 1] = digits[i];
-    }
-    return count;
-}
-#pragma GCC diagnostic pop
-
-
-}
-
-namespace json::detail
-{
-
-
-inline unsigned itoa(int32_t val, char* buf)
+//
+// value as compact text on os, size is its serializedSize(). A stream
+// with reserve() grows once, to the exact size; worth it for the size a
+// Content-Length needs anyway and for outputs of long strings, numbers
+// kept as text and the like, sizing a tree of small values costs about
+// half of writing it
+//
+template <typename WriteStream>
+inline void writeValue(const Value& value, WriteStream& os, size_t size)
 {
-    auto u = static_cast<uint32_t>(val);
-    if (val < 0) {
-        *buf++ = '-';
-        u = ~u + 1;
-    }
-    return (val < 0) + itoa_(u, buf);
+    if constexpr (detail::HasReserve<WriteStream>::value)
+        os.reserve(os.size() + size);
+    Writer<WriteStream> writer(os);
+    value.writeTo(writer);
 }
 
-
-inline unsigned itoa(int64_t val, char* buf)
+// sizes the value only for a stream with reserve()
+template <typename WriteStream>
+inline void writeValue(const Value& value, WriteStream& os)
 {
-    auto u = static_cast<uint64_t>(val);
-    if (val < 0) {
-        *buf++ = '-';
-        u = ~u + 1;
-    }
-    return (val < 0) + itoa_(u, buf);
+    if constexpr (detail::HasReserve<WriteStream>::value)
+        os.reserve(os.size() + value.serializedSize());
+    Writer<WriteStream> writer(os);
+    value.writeTo(writer);
 }
 
-
-
 }
 
 #endif //TJSON_HANDLER_H
@@ -1,6 +1,7 @@
 #include <benchmark/benchmark.h>
 
 #include <hjson/Document.h>
+#include <hjson/ImmutableDocument.h>
 #include <hjson/FileReadStream.h>
 #include <hjson/StringWriteStream.h>
 #include <hjson/Writer.h>
@@ -36,6 +37,47 @@ void BM_read_parse(benchmark::State &s, ExtraArgs &&... extra_args)
     }
 }
 
+static std::string readFile(const char* path)
+{
+    FILE *input = fopen(path, "r");
+    if (input == nullptr)
+        exit(1);
+    std::string json;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), input)) > 0)
+        json.append(buf, n);
+    fclose(input);
+    return json;
+}
+
+void BM_parse(benchmark::State &s, const char* path, unsigned flags)
+{
+    std::string json = readFile(path);
+    for (auto _: s) {
+        json::Document doc(flags);
+        if (doc.parse(json) != json::PARSE_OK) {
+            exit(1);
+        }
+    }
+}
+
+template <class ...ExtraArgs>
+void BM_read_parse_immutable(benchmark::State &s, ExtraArgs &&... extra_args)
+{
+    for (auto _: s) {
+        FILE *input = fopen(extra_args..., "r");
+        if (input == nullptr)
+            exit(1);
+        json::ImmutableDocument doc;
+        json::FileReadStream is(input);
+        fclose(input);
+        if (doc.parseStream(is) != json::PARSE_OK) {
+            exit(1);
+        }
+    }
+}
+
 template <class ...ExtraArgs>
 void BM_read_parse_write(benchmark::State &s, ExtraArgs&&... extra_args)
 {
@@ -59,10 +101,16 @@ void BM_read_parse_write(benchmark::State &s, ExtraArgs&&... extra_args)
 
 //BENCHMARK_CAPTURE(BM_read, many_double, "canada.json")->Unit(benchmark::kMillisecond);
 //BENCHMARK_CAPTURE(BM_read_parse, many_double, "canada.json")->Unit(benchmark::kMillisecond);
+//BENCHMARK_CAPTURE(BM_read_parse_immutable, many_double, "canada.json")->Unit(benchmark::kMillisecond);
+//BENCHMARK_CAPTURE(BM_parse, many_double, "canada.json", json::FLAG_NONE)->Unit(benchmark::kMillisecond);
+//BENCHMARK_CAPTURE(BM_parse, many_double_reserve, "canada.json", json::FLAG_RESERVE_EXACT)->Unit(benchmark::kMillisecond);
 BENCHMARK_CAPTURE(BM_read_parse_write, many_double, "canada.json")->Unit(benchmark::kMillisecond);
 
 //BENCHMARK_CAPTURE(BM_read, simple, "citm_catalog.json")->Unit(benchmark::kMillisecond);
 //BENCHMARK_CAPTURE(BM_read_parse, simple, "citm_catalog.json")->Unit(benchmark::kMillisecond);
+//BENCHMARK_CAPTURE(BM_read_parse_immutable, simple, "citm_catalog.json")->Unit(benchmark::kMillisecond);
+//BENCHMARK_CAPTURE(BM_parse, simple, "citm_catalog.json", json::FLAG_NONE)->Unit(benchmark::kMillisecond);
+//BENCHMARK_CAPTURE(BM_parse, simple_reserve, "citm_catalog.json", json::FLAG_RESERVE_EXACT)->Unit(benchmark::kMillisecond);
 BENCHMARK_CAPTURE(BM_read_parse_write, simple, "citm_catalog.json")->Unit(benchmark::kMillisecond);
 
 
@@ -0,0 +1,56 @@
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <mutex>
+
+#include <hjson/Document.h>
+#include <hjson/SharedDocument.h>
+
+// read scaling of one configuration shared by every thread
+
+static std::unique_ptr<json::Document> makeConfig()
+{
+    auto doc = std::make_unique<json::Document>();
+    doc->parse(R"({"server": {"host": "localhost", "port": 8080}, "workers": 16})");
+    return doc;
+}
+
+static const json::Value& port(const json::Value& config)
+{
+    return config["server"]["port"];
+}
+
+// copying the root bumps the reference count every reader shares
+void BM_value_copy(benchmark::State &s)
+{
+    static json::Value config = *makeConfig();
+    for (auto _: s) {
+        json::Value copy = config;
+        benchmark::DoNotOptimize(port(copy).getInt32());
+    }
+}
+
+// std::atomic_load of a shared_ptr, lock based on most implementations
+void BM_shared_ptr(benchmark::State &s)
+{
+    static std::shared_ptr<const json::Document> config(makeConfig());
+    for (auto _: s) {
+        auto snapshot = std::atomic_load(&config);
+        benchmark::DoNotOptimize(port(*snapshot).getInt32());
+    }
+}
+
+void BM_shared_document(benchmark::State &s)
+{
+    static json::SharedDocument<json::Document> config(makeConfig());
+    for (auto _: s) {
+        auto snapshot = config.pin();
+        benchmark::DoNotOptimize(port(*snapshot).getInt32());
+    }
+}
+
+BENCHMARK(BM_value_copy)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_shared_ptr)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(BM_shared_document)->ThreadRange(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,346 @@
+#include <gtest/gtest.h>
+
+#include <hjson/Binding.h>
+#include <hjson/Document.h>
+#include <hjson/PathQuery.h>
+#include <hjson/PrettyWriter.h>
+#include <hjson/Schema.h>
+#include <hjson/StringReadStream.h>
+#include <hjson/StringWriteStream.h>
+#include <hjson/Writer.h>
+
+using namespace json;
+
+namespace model
+{
+
+struct Address
+{
+    std::string city;
+    uint16_t zip = 0;
+};
+
+HJSON_FIELDS(Address, city, zip)
+
+struct Person
+{
+    std::string name;
+    int32_t age = 0;
+    bool admin = false;
+    double score = 0;
+    int64_t id = 0;
+    std::vector<std::string> tags;
+    std::vector<Address> addresses;
+    std::vector<Person> friends;
+    std::vector<std::vector<int>> matrix;
+};
+
+HJSON_FIELDS(Person, name, age, admin, score, id, tags, addresses, friends, matrix)
+
+struct Sample
+{
+    uint64_t count = 0;
+    float ratio = 0;
+    std::vector<bool> flags;
+};
+
+HJSON_FIELDS(Sample, count, ratio, flags)
+
+}
+
+static const char* kRecords = R"({
+    "version": 2,
+    "records": [
+        {"user": {"id": 1, "name": "a"}, "tags": ["x", "y"]},
+        {"user": {"id": 2, "name": "b"}, "tags": []},
+        {"user": {"name": "c"}, "tags": ["z"]},
+        {"user": {"id": 4, "name": "d"}, "tags": ["x"]}
+    ]
+})";
+
+static std::string toString(const Value& value)
+{
+    StringWriteStream os;
+    Writer writer(os);
+    value.writeTo(writer);
+    return std::string(os.get());
+}
+
+static std::vector<std::string> query(std::string_view path, std::string_view json = kRecords)
+{
+    std::vector<std::string> result;
+    PathQuery query(path);
+    EXPECT_TRUE(query.isValid()) << path;
+    ParseError err = query.run(json, [&](const Value& value) {
+        result.push_back(toString(value));
+    });
+    EXPECT_EQ(err, PARSE_OK) << path;
+    return result;
+}
+
+TEST(json_handler, path_compile)
+{
+    EXPECT_TRUE(PathQuery("$").isValid());
+    EXPECT_EQ(PathQuery("$").size(), 0);
+    EXPECT_EQ(PathQuery("$.a['b.c'][*].*[1:5:2]").size(), 5);
+    EXPECT_EQ(PathQuery("$['b.c']").step(0).name, "b.c");
+    EXPECT_EQ(PathQuery("$[\"it's\"]").step(0).name, "it's");
+    EXPECT_EQ(PathQuery("$[3]").step(0).kind, PathQuery::Step::SLICE);
+
+    EXPECT_FALSE(PathQuery("").isValid());
+    EXPECT_FALSE(PathQuery("a.b").isValid());
+    EXPECT_FALSE(PathQuery("$.").isValid());
+    EXPECT_FALSE(PathQuery("$[-1]").isValid());
+    EXPECT_FALSE(PathQuery("$[1:2:0]").isValid());
+    EXPECT_FALSE(PathQuery("$['a'").isValid());
+    EXPECT_FALSE(PathQuery("$[1").isValid());
+    EXPECT_FALSE(PathQuery("$x").isValid());
+}
+
+TEST(json_handler, path_query)
+{
+    using V = std::vector<std::string>;
+    EXPECT_EQ(query("$.version"), V{ "2" });
+    EXPECT_EQ(query("$.records[*].user.id"), (V{ "1", "2", "4" }));
+    EXPECT_EQ(query("$.records[1].user"), V{ R"({"id":2,"name":"b"})" });
+    EXPECT_EQ(query("$.records[1:].user['name']"), (V{ "\"b\"", "\"c\"", "\"d\"" }));
+    EXPECT_EQ(query("$.records[::2].user.name"), (V{ "\"a\"", "\"c\"" }));
+    EXPECT_EQ(query("$.records[*].tags[0]"), (V{ "\"x\"", "\"z\"", "\"x\"" }));
+    EXPECT_EQ(query("$.records[0].*"), (V{ R"({"id":1,"name":"a"})", R"(["x","y"])" }));
+    EXPECT_EQ(query("$.records[0].tags.*"), (V{ "\"x\"", "\"y\"" }));
+    EXPECT_EQ(query("$.missing[*]"), V{});
+    EXPECT_EQ(query("$.version.x"), V{});
+    EXPECT_EQ(query("$[0]"), V{});
+    EXPECT_EQ(query("$", "[1,{\"a\":[]}]"), V{ R"([1,{"a":[]}])" });
+    EXPECT_EQ(query("$", "\"s\""), V{ "\"s\"" });
+    EXPECT_EQ(query("$[*][*]", "[[1,2],{\"a\":3},[[4]]]"), (V{ "1", "2", "3", "[4]" }));
+}
+
+TEST(json_handler, path_query_stop)
+{
+    PathQuery query("$[*]");
+    int count = 0;
+    ParseError err = query.run("[1,2,3]", [&](const Value&) {
+        return ++count < 2;
+    });
+    EXPECT_EQ(err, PARSE_USER_STOPPED);
+    EXPECT_EQ(count, 2);
+}
+
+TEST(json_handler, path_query_error)
+{
+    PathQuery query("$.a");
+    auto ignore = [](const Value&) {};
+    EXPECT_EQ(query.run("{\"a\":1,", ignore), PARSE_MISS_KEY);
+    EXPECT_EQ(query.run("{\"b\":[1,2", ignore), PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_EQ(query.run("{\"b\":\"abc", ignore), PARSE_MISS_QUOTATION_MARK);
+    EXPECT_EQ(query.run("{\"b\":}", ignore), PARSE_BAD_VALUE);
+    EXPECT_EQ(query.run("{\"a\":tru}", ignore), PARSE_BAD_VALUE);
+    // skipped strings still honor escapes
+    int32_t a = 0;
+    ParseError err = query.run("{\"b\":\"x\\\"}\", \"a\":1}", [&](const Value& v) {
+        a = v.getInt32();
+    });
+    EXPECT_EQ(err, PARSE_OK);
+    EXPECT_EQ(a, 1);
+}
+
+TEST(json_handler, binding)
+{
+    const char* json = R"({
+        "name": "alice", "age": 30, "admin": true, "score": 4, "id": 12345678901,
+        "unknown": {"deep": [1, {"x": "y"}]}, "tags": ["a", "b"],
+        "addresses": [{"city": "x", "zip": 123, "extra": null}, {"city": "y"}],
+        "friends": [{"name": "bob", "age": 31, "friends": []}],
+        "matrix": [[1, 2], [], [3]],
+        "nothing": null
+    })";
+
+    model::Person p;
+    p.tags = { "stale" };
+    EXPECT_EQ(fromJson(json, p), PARSE_OK);
+    EXPECT_EQ(p.name, "alice");
+    EXPECT_EQ(p.age, 30);
+    EXPECT_TRUE(p.admin);
+    EXPECT_EQ(p.score, 4.0);
+    EXPECT_EQ(p.id, 12345678901);
+    EXPECT_EQ(p.tags, (std::vector<std::string>{ "a", "b" }));
+    ASSERT_EQ(p.addresses.size(), 2);
+    EXPECT_EQ(p.addresses[0].city, "x");
+    EXPECT_EQ(p.addresses[0].zip, 123);
+    EXPECT_EQ(p.addresses[1].zip, 0);
+    ASSERT_EQ(p.friends.size(), 1);
+    EXPECT_EQ(p.friends[0].name, "bob");
+    EXPECT_EQ(p.matrix, (std::vector<std::vector<int>>{ { 1, 2 }, {}, { 3 } }));
+
+    // the serializer writes what the binding reads
+    StringWriteStream os;
+    Writer writer(os);
+    EXPECT_TRUE(toJson(p, writer));
+    EXPECT_EQ(os.get(), R"({"name":"alice","age":30,"admin":true,"score":4.0,"id":12345678901,)"
+                        R"("tags":["a","b"],"addresses":[{"city":"x","zip":123},{"city":"y","zip":0}],)"
+                        R"("friends":[{"name":"bob","age":31,"admin":false,"score":0.0,"id":0,)"
+                        R"("tags":[],"addresses":[],"friends":[],"matrix":[]}],"matrix":[[1,2],[],[3]]})");
+
+    model::Person copy;
+    EXPECT_EQ(fromJson(os.get(), copy), PARSE_OK);
+    Document doc;
+    EXPECT_EQ(doc.parse(os.get()), PARSE_OK);
+    StringWriteStream os2;
+    Writer writer2(os2);
+    EXPECT_TRUE(toJson(copy, writer2));
+    EXPECT_EQ(os.get(), os2.get());
+
+    // same output as the DOM through PrettyWriter
+    model::Address address{ "z", 1 };
+    Value value(TYPE_OBJECT);
+    value.addMember("city", "z");
+    value.addMember("zip", 1);
+    StringWriteStream os3, os4;
+    PrettyWriter pretty3(os3), pretty4(os4);
+    EXPECT_TRUE(toJson(address, pretty3));
+    EXPECT_TRUE(value.writeTo(pretty4));
+    EXPECT_EQ(os3.get(), os4.get());
+}
+
+TEST(json_handler, binding_numbers)
+{
+    // past INT64_MAX stays positive, floats keep their own shortest text
+    model::Sample sample{ UINT64_MAX, 0.1f, { true, false, true } };
+    StringWriteStream os;
+    Writer writer(os);
+    EXPECT_TRUE(toJson(sample, writer));
+    EXPECT_EQ(os.get(), R"({"count":18446744073709551615,"ratio":0.1,"flags":[true,false,true]})");
+
+    // a Document gets the same numbers as the text
+    Document doc;
+    EXPECT_TRUE(toJson(sample, doc));
+    EXPECT_EQ(doc["count"].getDouble(), 18446744073709551615.0);
+    EXPECT_EQ(doc["ratio"].getDouble(), 0.1);
+
+    model::Sample copy;
+    copy.flags = { false };
+    EXPECT_EQ(fromJson(R"({"count": 7, "ratio": 0.1, "flags": [false, true]})", copy), PARSE_OK);
+    EXPECT_EQ(copy.count, 7u);
+    EXPECT_EQ(copy.ratio, 0.1f);
+    EXPECT_EQ(copy.flags, (std::vector<bool>{ false, true }));
+    EXPECT_EQ(fromJson(R"({"flags": [1]})", copy), PARSE_TYPE_MISMATCH);
+}
+
+TEST(json_handler, binding_error)
+{
+    model::Person p;
+    EXPECT_EQ(fromJson(R"({"age": "old"})", p), PARSE_TYPE_MISMATCH);
+    EXPECT_EQ(fromJson(R"({"age": 1.5})", p), PARSE_TYPE_MISMATCH);
+    EXPECT_EQ(fromJson(R"({"age": 3000000000})", p), PARSE_TYPE_MISMATCH);
+    EXPECT_EQ(fromJson(R"({"addresses": [{"zip": -1}]})", p), PARSE_TYPE_MISMATCH);
+    EXPECT_EQ(fromJson(R"({"tags": {}})", p), PARSE_TYPE_MISMATCH);
+    EXPECT_EQ(fromJson(R"([])", p), PARSE_TYPE_MISMATCH);
+    EXPECT_EQ(fromJson(R"({"name": "x",})", p), PARSE_MISS_KEY);
+    EXPECT_EQ(fromJson(R"({"other": [1,)", p), PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_STREQ(parseErrorStr(PARSE_TYPE_MISMATCH), "value does not match the bound type");
+}
+
+TEST(json_handler, schema)
+{
+    Document schemaDoc;
+    ASSERT_EQ(schemaDoc.parse(R"({
+        "type": "object",
+        "required": ["name", "age"],
+        "properties": {
+            "name": {"type": "string", "minLength": 1, "maxLength": 4},
+            "age": {"type": "integer", "minimum": 0, "maximum": 150},
+            "score": {"type": ["number", "null"]},
+            "role": {"enum": ["admin", "user", 7]},
+            "tags": {"type": "array", "maxItems": 2, "items": {"type": "string"}}
+        }
+    })"), PARSE_OK);
+    Schema schema(schemaDoc);
+    ASSERT_TRUE(schema.isValid());
+
+    auto validate = [&schema](std::string_view json, std::string* pointer = nullptr) {
+        Document doc;
+        SchemaValidator<Document> validator(schema, doc);
+        StringReadStream is(json);
+        ParseError err = Reader::parse(is, validator);
+        EXPECT_EQ(err == PARSE_USER_STOPPED, validator.error() != SCHEMA_OK);
+        if (pointer != nullptr)
+            *pointer = validator.errorPointer();
+        return validator.error();
+    };
+
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 3, "score": null, "role": 7, "tags": ["x"]})"), SCHEMA_OK);
+    EXPECT_EQ(validate(R"({"age": 3.0, "name": "\u00e9\u00e9\u00e9\u00e9", "other": [{}]})"), SCHEMA_OK);
+
+    std::string pointer;
+    EXPECT_EQ(validate(R"({"name": "ab", "age": "3"})", &pointer), SCHEMA_TYPE);
+    EXPECT_EQ(pointer, "/age");
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 3.5})"), SCHEMA_TYPE);
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 151})"), SCHEMA_MAXIMUM);
+    EXPECT_EQ(validate(R"({"name": "ab", "age": -1})"), SCHEMA_MINIMUM);
+    EXPECT_EQ(validate(R"({"name": "", "age": 1})"), SCHEMA_MIN_LENGTH);
+    EXPECT_EQ(validate(R"({"name": "abcde", "age": 1})"), SCHEMA_MAX_LENGTH);
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 1, "role": "root"})"), SCHEMA_ENUM);
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 1, "role": 7.0})"), SCHEMA_OK);
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 1, "tags": ["a", 1]})", &pointer), SCHEMA_TYPE);
+    EXPECT_EQ(pointer, "/tags/1");
+    EXPECT_EQ(validate(R"({"name": "ab", "age": 1, "tags": ["a", "b", "c"]})", &pointer), SCHEMA_MAX_ITEMS);
+    EXPECT_EQ(pointer, "/tags/2");
+    EXPECT_EQ(validate(R"({"name": "ab"})", &pointer), SCHEMA_REQUIRED);
+    EXPECT_EQ(pointer, "");
+    EXPECT_EQ(validate(R"([])"), SCHEMA_TYPE);
+    EXPECT_STREQ(schemaErrorStr(SCHEMA_REQUIRED), "required property missing");
+
+    // fail fast: nothing after the violation reaches the reader
+    Document doc;
+    SchemaValidator<Document> validator(schema, doc);
+    StringReadStream is(R"({"age": -1, "name": [1, 2)");
+    EXPECT_EQ(Reader::parse(is, validator), PARSE_USER_STOPPED);
+    EXPECT_EQ(validator.error(), SCHEMA_MINIMUM);
+
+    // downstream writer gets the valid payload unchanged
+    StringWriteStream os;
+    Writer writer(os);
+    SchemaValidator<Writer<StringWriteStream>> validWriter(schema, writer);
+    StringReadStream is2(R"({"name":"ab","age":1,"tags":["x"]})");
+    EXPECT_EQ(Reader::parse(is2, validWriter), PARSE_OK);
+    EXPECT_EQ(os.get(), R"({"name":"ab","age":1,"tags":["x"]})");
+}
+
+TEST(json_handler, schema_compile)
+{
+    auto compile = [](std::string_view json) {
+        Document doc;
+        EXPECT_EQ(doc.parse(json), PARSE_OK);
+        return Schema(doc).isValid();
+    };
+    EXPECT_TRUE(compile(R"({})"));
+    EXPECT_TRUE(compile(R"({"title": "ignored", "items": {"minimum": 1.5}})"));
+    EXPECT_FALSE(compile(R"([])"));
+    EXPECT_FALSE(compile(R"({"type": "decimal"})"));
+    EXPECT_FALSE(compile(R"({"required": [1]})"));
+    EXPECT_FALSE(compile(R"({"enum": [[1]]})"));
+    EXPECT_FALSE(compile(R"({"maxLength": -1})"));
+    EXPECT_FALSE(compile(R"({"properties": {"a": 1}})"));
+
+    // the property index of wide schemas
+    std::string json = R"({"properties": {)";
+    for (int i = 0; i < 20; i++)
+        json += (i == 0 ? "" : ",") + ("\"k" + std::to_string(i) + "\": {\"type\": \"integer\"}");
+    json += "}}";
+    Document doc;
+    ASSERT_EQ(doc.parse(json), PARSE_OK);
+    Schema schema(doc);
+    ASSERT_TRUE(schema.isValid());
+    Document out;
+    SchemaValidator<Document> validator(schema, out);
+    StringReadStream is(R"({"k3": 1, "k19": "x"})");
+    EXPECT_EQ(Reader::parse(is, validator), PARSE_USER_STOPPED);
+    EXPECT_EQ(validator.errorPointer(), "/k19");
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+
+#include <hjson/Document.h>
+#include <hjson/Patch.h>
+#include <hjson/Pointer.h>
+#include <hjson/StringWriteStream.h>
+#include <hjson/Writer.h>
+
+using namespace json;
+
+static Value parse(std::string_view json)
+{
+    Document doc;
+    EXPECT_EQ(doc.parse(json), PARSE_OK) << json;
+    return doc;
+}
+
+static std::string toString(const Value& value)
+{
+    StringWriteStream os;
+    Writer writer(os);
+    value.writeTo(writer);
+    return std::string(os.get());
+}
+
+// RFC 6901 section 5
+static const char* kRfcExample = R"({
+    "foo": ["bar", "baz"],
+    "": 0,
+    "a/b": 1,
+    "c%d": 2,
+    "e^f": 3,
+    "g|h": 4,
+    "i\\j": 5,
+    "k\"l": 6,
+    " ": 7,
+    "m~n": 8
+})";
+
+TEST(json_pointer, parse)
+{
+    EXPECT_TRUE(CompiledPointer("").isValid());
+    EXPECT_EQ(CompiledPointer("").size(), 0);
+    EXPECT_TRUE(CompiledPointer("/").isValid());
+    EXPECT_EQ(CompiledPointer("/").token(0), "");
+    EXPECT_EQ(CompiledPointer("/a~1b/m~0n").token(0), "a/b");
+    EXPECT_EQ(CompiledPointer("/a~1b/m~0n").token(1), "m~n");
+    EXPECT_EQ(CompiledPointer("/~01").token(0), "~1");
+    EXPECT_EQ(CompiledPointer("/foo/0").index(1), 0);
+    EXPECT_EQ(CompiledPointer("/foo/10").index(1), 10);
+    EXPECT_EQ(CompiledPointer("/foo/01").index(1), CompiledPointer::npos);
+    EXPECT_EQ(CompiledPointer("/foo/-").index(1), CompiledPointer::npos);
+
+    EXPECT_FALSE(CompiledPointer("foo").isValid());
+    EXPECT_FALSE(CompiledPointer("/~").isValid());
+    EXPECT_FALSE(CompiledPointer("/~2").isValid());
+}
+
+TEST(json_pointer, get)
+{
+    Document doc;
+    EXPECT_EQ(doc.parse(kRfcExample), PARSE_OK);
+    const Value& cdoc = doc;
+
+    EXPECT_EQ(CompiledPointer("").get(cdoc), &cdoc);
+    EXPECT_EQ(CompiledPointer("/foo").get(cdoc)->getSize(), 2);
+    EXPECT_EQ(CompiledPointer("/foo/0").get(cdoc)->getStringView(), "bar");
+    EXPECT_EQ(CompiledPointer("/").get(cdoc)->getInt32(), 0);
+    EXPECT_EQ(CompiledPointer("/a~1b").get(cdoc)->getInt32(), 1);
+    EXPECT_EQ(CompiledPointer("/c%d").get(cdoc)->getInt32(), 2);
+    EXPECT_EQ(CompiledPointer("/i\\j").get(cdoc)->getInt32(), 5);
+    EXPECT_EQ(CompiledPointer("/k\"l").get(cdoc)->getInt32(), 6);
+    EXPECT_EQ(CompiledPointer("/ ").get(cdoc)->getInt32(), 7);
+    EXPECT_EQ(CompiledPointer("/m~0n").get(cdoc)->getInt32(), 8);
+
+    EXPECT_EQ(CompiledPointer("/foo/2").get(cdoc), nullptr);
+    EXPECT_EQ(CompiledPointer("/foo/-").get(cdoc), nullptr);
+    EXPECT_EQ(CompiledPointer("/foo/bar").get(cdoc), nullptr);
+    EXPECT_EQ(CompiledPointer("/missing").get(cdoc), nullptr);
+    EXPECT_EQ(CompiledPointer("/a~1b/x").get(cdoc), nullptr);
+    EXPECT_EQ(CompiledPointer("bad").get(cdoc), nullptr);
+}
+
+TEST(json_pointer, hint)
+{
+    CompiledPointer pointer("/user/id");
+    Document doc;
+
+    // same layout, the hint is used
+    for (int i = 0; i < 3; i++) {
+        std::string json = "{\"version\":1, \"user\":{\"name\":\"x\", \"id\":" + std::to_string(i) + "}}";
+        EXPECT_EQ(doc.parse(json), PARSE_OK);
+        EXPECT_EQ(pointer.get(static_cast<const Value&>(doc))->getInt32(), i);
+    }
+    // other layouts still resolve
+    EXPECT_EQ(doc.parse("{\"user\":{\"id\":7}}"), PARSE_OK);
+    EXPECT_EQ(pointer.get(static_cast<const Value&>(doc))->getInt32(), 7);
+    EXPECT_EQ(doc.parse("{\"user\":{\"a\":1, \"b\":2, \"ID\":3}}"), PARSE_OK);
+    EXPECT_EQ(pointer.get(static_cast<const Value&>(doc)), nullptr);
+
+    // copies keep working
+    CompiledPointer copy = pointer;
+    EXPECT_EQ(doc.parse("{\"user\":{\"name\":\"x\", \"id\":9}}"), PARSE_OK);
+    EXPECT_EQ(copy.get(static_cast<const Value&>(doc))->getInt32(), 9);
+}
+
+TEST(json_pointer, mutable_get)
+{
+    Document doc;
+    EXPECT_EQ(doc.parse("{\"a\":{\"b\":[1,2,3]}}"), PARSE_OK);
+    Value copy = doc;
+
+    CompiledPointer pointer("/a/b/1");
+    pointer.get(doc)->setInt32(20);
+
+    const Value& cdoc = doc;
+    EXPECT_EQ(cdoc["a"]["b"][1].getInt32(), 20);
+    // the copy shared the nodes before the write
+    EXPECT_EQ(copy["a"]["b"][1].getInt32(), 2);
+}
+
+// RFC 7396 appendix A
+TEST(json_pointer, merge_patch)
+{
+#define TEST_MERGE(target, patch, result) do { \
+    Value value = parse(target); \
+    mergePatch(value, parse(patch)); \
+    EXPECT_EQ(toString(value), result); \
+} while(false)
+
+    TEST_MERGE(R"({"a":"b"})", R"({"a":"c"})", R"({"a":"c"})");
+    TEST_MERGE(R"({"a":"b"})", R"({"b":"c"})", R"({"a":"b","b":"c"})");
+    TEST_MERGE(R"({"a":"b"})", R"({"a":null})", R"({})");
+    TEST_MERGE(R"({"a":"b","b":"c"})", R"({"a":null})", R"({"b":"c"})");
+    TEST_MERGE(R"({"a":["b"]})", R"({"a":"c"})", R"({"a":"c"})");
+    TEST_MERGE(R"({"a":"c"})", R"({"a":["b"]})", R"({"a":["b"]})");
+    TEST_MERGE(R"({"a":{"b":"c"}})", R"({"a":{"b":"d","c":null}})", R"({"a":{"b":"d"}})");
+    TEST_MERGE(R"({"a":[{"b":"c"}]})", R"({"a":[1]})", R"({"a":[1]})");
+    TEST_MERGE(R"(["a","b"])", R"(["c","d"])", R"(["c","d"])");
+    TEST_MERGE(R"({"a":"b"})", R"(["c"])", R"(["c"])");
+    TEST_MERGE(R"({"a":"foo"})", R"(null)", R"(null)");
+    TEST_MERGE(R"({"a":"foo"})", R"("bar")", R"("bar")");
+    TEST_MERGE(R"({"e":null})", R"({"a":1})", R"({"e":null,"a":1})");
+    TEST_MERGE(R"([1,2])", R"({"a":"b","c":null})", R"({"a":"b"})");
+    TEST_MERGE(R"({})", R"({"a":{"bb":{"ccc":null}}})", R"({"a":{"bb":{}}})");
+
+#undef TEST_MERGE
+}
+
+TEST(json_pointer, patch)
+{
+#define TEST_PATCH(target, patch, result) do { \
+    Value value = parse(target); \
+    EXPECT_EQ(applyPatch(value, parse(patch)), PATCH_OK); \
+    EXPECT_EQ(toString(value), result); \
+} while(false)
+
+#define TEST_PATCH_ERROR(error, target, patch) do { \
+    Value value = parse(target); \
+    EXPECT_EQ(applyPatch(value, parse(patch)), error); \
+    EXPECT_EQ(toString(value), target); \
+} while(false)
+
+    // RFC 6902 appendix A
+    TEST_PATCH(R"({"foo":"bar"})", R"([{"op":"add","path":"/baz","value":"qux"}])",
+               R"({"foo":"bar","baz":"qux"})");
+    TEST_PATCH(R"({"foo":["bar","baz"]})", R"([{"op":"add","path":"/foo/1","value":"qux"}])",
+               R"({"foo":["bar","qux","baz"]})");
+    TEST_PATCH(R"({"baz":"qux","foo":"bar"})", R"([{"op":"remove","path":"/baz"}])",
+               R"({"foo":"bar"})");
+    TEST_PATCH(R"({"foo":["bar","qux","baz"]})", R"([{"op":"remove","path":"/foo/1"}])",
+               R"({"foo":["bar","baz"]})");
+    TEST_PATCH(R"({"baz":"qux","foo":"bar"})", R"([{"op":"replace","path":"/baz","value":"boo"}])",
+               R"({"baz":"boo","foo":"bar"})");
+    TEST_PATCH(R"({"foo":{"bar":"baz","waldo":"fred"},"qux":{"corge":"grault"}})",
+               R"([{"op":"move","from":"/foo/waldo","path":"/qux/thud"}])",
+               R"({"foo":{"bar":"baz"},"qux":{"corge":"grault","thud":"fred"}})");
+    TEST_PATCH(R"({"foo":["all","grass","cows","eat"]})",
+               R"([{"op":"move","from":"/foo/1","path":"/foo/3"}])",
+               R"({"foo":["all","cows","eat","grass"]})");
+    TEST_PATCH(R"({"baz":"qux","foo":["a",2,"c"]})",
+               R"([{"op":"test","path":"/baz","value":"qux"},{"op":"test","path":"/foo/1","value":2.0}])",
+               R"({"baz":"qux","foo":["a",2,"c"]})");
+    TEST_PATCH(R"({"foo":"bar"})", R"([{"op":"add","path":"/child","value":{"grandchild":{}}}])",
+               R"({"foo":"bar","child":{"grandchild":{}}})");
+    TEST_PATCH(R"({"foo":["bar"]})", R"([{"op":"add","path":"/foo/-","value":["abc","def"]}])",
+               R"({"foo":["bar",["abc","def"]]})");
+    TEST_PATCH(R"({"foo":"bar"})", R"([{"op":"copy","from":"/foo","path":"/baz"}])",
+               R"({"foo":"bar","baz":"bar"})");
+    TEST_PATCH(R"({"foo":"bar"})", R"([{"op":"replace","path":"","value":[1]}])", R"([1])");
+    TEST_PATCH(R"({"foo":"bar"})", R"([{"op":"add","path":"/foo","value":1}])", R"({"foo":1})");
+    TEST_PATCH(R"({"a":{"b":1}})", R"([{"op":"test","path":"","value":{"a":{"b":1.0}}}])", R"({"a":{"b":1}})");
+
+    // atomic, the document is unchanged after any error
+    TEST_PATCH_ERROR(PATCH_TEST_FAILED, R"({"baz":"qux"})",
+                     R"([{"op":"add","path":"/a","value":1},{"op":"test","path":"/baz","value":"bar"}])");
+    TEST_PATCH_ERROR(PATCH_PATH_NOT_FOUND, R"({"foo":"bar"})", R"([{"op":"add","path":"/baz/bat","value":"qux"}])");
+    TEST_PATCH_ERROR(PATCH_PATH_NOT_FOUND, R"({"foo":"bar"})", R"([{"op":"remove","path":"/baz"}])");
+    TEST_PATCH_ERROR(PATCH_PATH_NOT_FOUND, R"({"foo":"bar"})", R"([{"op":"replace","path":"/baz","value":1}])");
+    TEST_PATCH_ERROR(PATCH_BAD_INDEX, R"([1,2])", R"([{"op":"add","path":"/3","value":3}])");
+    TEST_PATCH_ERROR(PATCH_BAD_INDEX, R"([1,2])", R"([{"op":"add","path":"/01","value":3}])");
+    TEST_PATCH_ERROR(PATCH_MOVE_INTO_CHILD, R"({"a":{"b":1}})", R"([{"op":"move","from":"/a","path":"/a/c"}])");
+    TEST_PATCH_ERROR(PATCH_BAD_POINTER, R"({"a":1})", R"([{"op":"remove","path":"a"}])");
+    TEST_PATCH_ERROR(PATCH_BAD_OPERATION, R"({"a":1})", R"([{"op":"frobnicate","path":"/a"}])");
+    TEST_PATCH_ERROR(PATCH_BAD_OPERATION, R"({"a":1})", R"([{"op":"add","path":"/b"}])");
+    TEST_PATCH_ERROR(PATCH_BAD_OPERATION, R"({"a":1})", R"([{"path":"/a"}])");
+    TEST_PATCH_ERROR(PATCH_NOT_ARRAY, R"({"a":1})", R"({"op":"remove","path":"/a"})");
+    EXPECT_STREQ(patchErrorStr(PATCH_TEST_FAILED), "test failed");
+
+#undef TEST_PATCH
+#undef TEST_PATCH_ERROR
+}
+
+TEST(json_pointer, patch_sharing)
+{
+    Value original = parse(R"({"big":{"list":[1,2,3],"map":{"x":1}},"small":{"n":1},"other":[true]})");
+    const Value& corig = original;
+
+    Value patched = original;
+    EXPECT_EQ(applyPatch(patched, parse(R"([{"op":"replace","path":"/small/n","value":2}])")), PATCH_OK);
+    const Value& cpatched = patched;
+    EXPECT_EQ(cpatched["small"]["n"].getInt32(), 2);
+    EXPECT_EQ(corig["small"]["n"].getInt32(), 1);
+    // only the spine was copied
+    EXPECT_FALSE(cpatched.sameStorage(corig));
+    EXPECT_FALSE(cpatched["small"].sameStorage(corig["small"]));
+    EXPECT_TRUE(cpatched["big"].sameStorage(corig["big"]));
+    EXPECT_TRUE(cpatched["other"].sameStorage(corig["other"]));
+
+    Value merged = original;
+    mergePatch(merged, parse(R"({"big":{"map":{"y":2}}})"));
+    const Value& cmerged = merged;
+    EXPECT_TRUE(cmerged["big"]["list"].sameStorage(corig["big"]["list"]));
+    EXPECT_TRUE(cmerged["small"].sameStorage(corig["small"]));
+    EXPECT_EQ(cmerged["big"]["map"].getSize(), 2);
+    EXPECT_EQ(corig["big"]["map"].getSize(), 1);
+}
+
+TEST(json_pointer, diff)
+{
+#define TEST_DIFF(a, b, patch) do { \
+    Value from = parse(a); \
+    Value to = parse(b); \
+    Value ops = diff(from, to); \
+    EXPECT_EQ(toString(ops), patch); \
+    EXPECT_EQ(applyPatch(from, ops), PATCH_OK); \
+    EXPECT_TRUE(from == to); \
+} while(false)
+
+    TEST_DIFF(R"({"a":1,"b":[1,2]})", R"({"b":[1,2],"a":1})", R"([])");
+    TEST_DIFF(R"(1)", R"(1.0)", R"([{"op":"replace","path":"","value":1.0}])");
+    TEST_DIFF(R"({"a":1,"b":2})", R"({"a":3,"c":4})",
+              R"([{"op":"replace","path":"/a","value":3},{"op":"remove","path":"/b"},)"
+              R"({"op":"add","path":"/c","value":4}])");
+    TEST_DIFF(R"({"a/b":{"m~n":1}})", R"({"a/b":{"m~n":2}})",
+              R"([{"op":"replace","path":"/a~1b/m~0n","value":2}])");
+    TEST_DIFF(R"([1,2,3,4,5])", R"([1,2,9,3,4,5])", R"([{"op":"add","path":"/2","value":9}])");
+    TEST_DIFF(R"([1,2,3,4,5])", R"([1,4,5])",
+              R"([{"op":"remove","path":"/2"},{"op":"remove","path":"/1"}])");
+    TEST_DIFF(R"([1,[2,3],4])", R"([1,[2,5],4])", R"([{"op":"replace","path":"/1/1","value":5}])");
+    TEST_DIFF(R"([])", R"([[]])", R"([{"op":"add","path":"/0","value":[]}])");
+    TEST_DIFF(R"({"a":[]})", R"({"a":{}})", R"([{"op":"replace","path":"/a","value":{}}])");
+
+#undef TEST_DIFF
+
+    // copies share everything but the changed spine, nothing else is walked
+    Value base = parse(R"({"big":{"list":[1,2,3]},"small":{"n":1}})");
+    Value next = base;
+    EXPECT_EQ(applyPatch(next, parse(R"([{"op":"replace","path":"/small/n","value":2}])")), PATCH_OK);
+    EXPECT_EQ(toString(diff(base, next)), R"([{"op":"replace","path":"/small/n","value":2}])");
+    EXPECT_EQ(diff(base, base).getSize(), 0);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 
+#include <limits>
+#include <string>
+
 #include <hjson/Document.h>
 #include <hjson/StringWriteStream.h>
 #include <hjson/Writer.h>
@@ -39,6 +42,29 @@ TEST(json_round, number)
     TEST_ROUNDTRIP("-2.2250738585072014e-308");
     TEST_ROUNDTRIP("1.7976931348623157e+308");
     TEST_ROUNDTRIP("-1.7976931348623157e+308");
+
+    // shortest form, still marked as double
+    TEST_ROUNDTRIP("0.1");
+    TEST_ROUNDTRIP("1.0");
+    TEST_ROUNDTRIP("-1.0");
+    TEST_ROUNDTRIP("-0.0");
+    TEST_ROUNDTRIP("1e+21");
+    TEST_ROUNDTRIP("[0.3,1e-07,123456.789]");
+}
+
+TEST(json_round, double_format)
+{
+    auto format = [](double d) {
+        char buf[32];
+        return std::string(buf, detail::dtoa(d, buf));
+    };
+    EXPECT_EQ(format(0.1 + 0.2), "0.30000000000000004");
+    EXPECT_EQ(format(100.0), "100.0");
+    EXPECT_EQ(format(5e-324), "5e-324");
+    for (double d: { 0.1, 1.0 / 3, 2.5e-300, 6.02214076e23, -123.456 }) {
+        std::string text = format(d);
+        EXPECT_EQ(strtod(text.c_str(), nullptr), d) << text;
+    }
 }
 
 TEST(json_round, string)
@@ -49,6 +75,21 @@ TEST(json_round, string)
     TEST_ROUNDTRIP("\"Hello\\nWorld\"");
     TEST_ROUNDTRIP("\"\\\" \\\\ / \\b \\f \\n \\r \\t\"");
     TEST_ROUNDTRIP("\"Hello\\u0000World\"");
+    // escapes at every position of the vectorized scan
+    TEST_ROUNDTRIP("\"0123456789abcdef\\\"0123456789abcde\\\\0123456789\\u001F\"");
+    TEST_ROUNDTRIP("\"\\t0123456789abcdefghijklmnopqrstuvwxyz\\n\"");
+    TEST_ROUNDTRIP("\"\x7F 蛤蛤蛤蛤蛤蛤 \\r\"");
+}
+
+TEST(json_round, key)
+{
+    TEST_ROUNDTRIP("{\"a\\\"b\":1,\"c\\\\d\\n\":2}");
+    Value value(TYPE_OBJECT);
+    value.addMember("say \"hi\"", 1);
+    StringWriteStream os;
+    Writer writer(os);
+    value.writeTo(writer);
+    EXPECT_EQ(os.get(), "{\"say \\\"hi\\\"\":1}");
 }
 
 TEST(json_round, array)
@@ -63,6 +104,71 @@ TEST(json_round, object)
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
+static std::string writeCompact(const Value& value)
+{
+    StringWriteStream os;
+    Writer writer(os);
+    value.writeTo(writer);
+    return std::string(os.get());
+}
+
+TEST(json_round, serialized_size)
+{
+    const char* texts[] = {
+        "null", "true", "false", "0", "-1", "-2147483648", "9223372036854775807",
+        "-9223372036854775808", "0.1", "1e300", "-2.5e-300", "\"\"",
+        "\"a\\\"b\\\\c\\n\\u0001\\u001F\x7F\"",
+        "[]", "{}", "[[],{},[1]]",
+        "{\"k\\tey\":[1,2.5,-3,\"x\"],\"n\":{\"deep\":[null,true]}}",
+        "[1,2,3,4000000000,-5]", "[0.5,1.25,-1e-10]", "[[1,2],[3,4],[5,6]]",
+        "[[0.5,1.5,2.5],[3.5,4.5,5.5]]", "[1.00,2.50000,3e0]",
+    };
+    const unsigned flagSets[] = {
+        FLAG_NONE, FLAG_PACK_ARRAYS, FLAG_PACK_ARRAYS | FLAG_PACK_FLOAT, FLAG_LAZY_NUMBERS
+    };
+    for (unsigned flags: flagSets) {
+        for (const char* text: texts) {
+            Document doc(flags);
+            ASSERT_EQ(doc.parse(text), PARSE_OK) << text;
+            std::string out = writeCompact(doc);
+            EXPECT_EQ(doc.serializedSize(), out.size()) << text;
+        }
+    }
+
+    Value special(TYPE_ARRAY);
+    special.addValue(Value(std::numeric_limits<double>::infinity()));
+    special.addValue(Value(-std::numeric_limits<double>::infinity()));
+    special.addValue(Value(std::numeric_limits<double>::quiet_NaN()));
+    EXPECT_EQ(special.serializedSize(), writeCompact(special).size());
+}
+
+TEST(json_round, serialized_size_after_change)
+{
+    Document doc;
+    ASSERT_EQ(doc.parse(R"({"a":{"b":[1,2]},"c":"x"})"), PARSE_OK);
+    Value shared = doc;
+    EXPECT_EQ(doc.serializedSize(), 25);
+
+    doc["a"]["b"].addValue(Value(1000));
+    doc["c"].setString("longer");
+    EXPECT_EQ(doc.serializedSize(), writeCompact(doc).size());
+    EXPECT_EQ(doc.serializedSize(), 35);
+    // the copy kept the old nodes
+    EXPECT_EQ(shared.serializedSize(), 25);
+
+    // the buffer is allocated once, to the exact size
+    StringWriteStream os;
+    writeValue(doc, os);
+    EXPECT_EQ(os.get(), writeCompact(doc));
+    EXPECT_EQ(os.size(), doc.serializedSize());
+
+    // with the size already known, e.g. for a Content-Length
+    size_t size = doc.serializedSize();
+    StringWriteStream known;
+    writeValue(doc, known, size);
+    EXPECT_EQ(known.size(), size);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
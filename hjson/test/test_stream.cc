@@ -0,0 +1,389 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <hjson/AsyncFileWriteStream.h>
+#include <hjson/Document.h>
+#include <hjson/FdWriteStream.h>
+#include <hjson/FileWriteStream.h>
+#include <hjson/FixedBufferWriteStream.h>
+#include <hjson/IovecWriteStream.h>
+#include <hjson/ParallelWriter.h>
+#include <hjson/PrettyWriter.h>
+#include <hjson/StringWriteStream.h>
+#include <hjson/Writer.h>
+
+using namespace json;
+
+// heap allocations made by this program. Kept out of line where
+// possible, gcc warns about malloc/free against new/delete once inlined
+#if defined(__GNUC__)
+#define TEST_NOINLINE __attribute__((noinline))
+#else
+#define TEST_NOINLINE
+#endif
+
+static std::atomic<size_t> allocations{0};
+
+TEST_NOINLINE void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+TEST_NOINLINE void operator delete(void* p) noexcept
+{ free(p); }
+TEST_NOINLINE void operator delete(void* p, size_t) noexcept
+{ free(p); }
+
+static const char kSample[] =
+        "{\"n\":null,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1.5,2,3],\"o\":{\"k\":\"v\"}}";
+
+static std::string readBack(FILE* file)
+{
+    fflush(file);
+    rewind(file);
+    std::string text;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+        text.append(buf, n);
+    return text;
+}
+
+template <typename WriteStream>
+static void writeSample(WriteStream& os)
+{
+    Document doc;
+    EXPECT_EQ(doc.parse(kSample), PARSE_OK);
+    Writer writer(os);
+    doc.writeTo(writer);
+}
+
+TEST(json_stream, file)
+{
+    // a buffer of every size, down to one byte
+    for (size_t size: { size_t(1), size_t(7), size_t(64), FileWriteStream::kDefaultBufferSize }) {
+        FILE* file = tmpfile();
+        ASSERT_NE(file, nullptr);
+        {
+            FileWriteStream os(file, size);
+            writeSample(os);
+            EXPECT_TRUE(os.flush());
+            os.put(std::string_view("[\"a long fragment that does not fit\"]"));
+        }
+        EXPECT_EQ(readBack(file), std::string(kSample) + "[\"a long fragment that does not fit\"]");
+        fclose(file);
+    }
+}
+
+TEST(json_stream, file_needs_flush)
+{
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    {
+        FileWriteStream os(file);
+        os.put("[1]");
+        EXPECT_EQ(readBack(file), "");
+        EXPECT_TRUE(os.flush());
+        EXPECT_EQ(readBack(file), "[1]");
+    }
+    fclose(file);
+}
+
+TEST(json_stream, file_closed_before_stream)
+{
+    // closing the FILE while the flushed stream is still in scope
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    FileWriteStream os(file);
+    writeSample(os);
+    EXPECT_TRUE(os.flush());
+    EXPECT_EQ(readBack(file), kSample);
+    fclose(file);
+}
+
+TEST(json_stream, fd)
+{
+    std::string big(100, 'x');
+    for (size_t size: { size_t(1), size_t(7), size_t(64), FdWriteStream::kDefaultBufferSize }) {
+        for (SyncPolicy policy: { SYNC_NONE, SYNC_ON_FLUSH, SYNC_ON_CLOSE }) {
+            FILE* file = tmpfile();
+            ASSERT_NE(file, nullptr);
+            {
+                FdWriteStream os(fileno(file), policy, size);
+                writeSample(os);
+                os.put(std::string_view(big));
+                os.put(',');
+                EXPECT_TRUE(os.flush());
+                os.put(std::string_view(big));
+                EXPECT_EQ(os.error(), 0);
+            }
+            EXPECT_EQ(readBack(file), kSample + big + "," + big);
+            fclose(file);
+        }
+    }
+}
+
+TEST(json_stream, fd_error)
+{
+    FdWriteStream os(-1, SYNC_NONE, 16);
+    os.put("[1,2,3]");
+    EXPECT_EQ(os.error(), 0);
+    EXPECT_FALSE(os.flush());
+    EXPECT_EQ(os.error(), EBADF);
+    // later output is dropped, the first error stays
+    os.put(std::string_view("a fragment larger than the buffer"));
+    EXPECT_FALSE(os.flush());
+    EXPECT_EQ(os.error(), EBADF);
+}
+
+TEST(json_stream, async)
+{
+    std::string big(100, 'x');
+    for (size_t size: { size_t(1), size_t(7), size_t(64), AsyncFileWriteStream::kDefaultBufferSize }) {
+        for (SyncPolicy policy: { SYNC_NONE, SYNC_ON_FLUSH, SYNC_ON_CLOSE }) {
+            FILE* file = tmpfile();
+            ASSERT_NE(file, nullptr);
+            AsyncFileWriteStream os(fileno(file), policy, size);
+            writeSample(os);
+            os.put(std::string_view(big));
+            EXPECT_TRUE(os.flush());
+            EXPECT_EQ(readBack(file), kSample + big);
+            os.put(',');
+            os.put(std::string_view(big));
+            EXPECT_EQ(os.close(), 0);
+            EXPECT_EQ(os.close(), 0);
+            EXPECT_EQ(readBack(file), kSample + big + "," + big);
+            fclose(file);
+        }
+    }
+}
+
+TEST(json_stream, async_back_pressure)
+{
+    // a reader slower than the writer, through a pipe
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    std::string received;
+    std::thread reader([&] {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+            received.append(buf, static_cast<size_t>(n));
+            std::this_thread::yield();
+        }
+    });
+
+    std::string expect;
+    {
+        AsyncFileWriteStream os(fds[1], SYNC_ON_CLOSE, 1000);
+        for (int i = 0; i < 20000; i++) {
+            std::string line = std::to_string(i) + "\n";
+            os.put(std::string_view(line));
+            expect += line;
+        }
+        EXPECT_EQ(os.close(), 0);
+    }
+    ::close(fds[1]);
+    reader.join();
+    ::close(fds[0]);
+    EXPECT_EQ(received, expect);
+}
+
+TEST(json_stream, async_error)
+{
+    AsyncFileWriteStream os(-1, SYNC_NONE, 16);
+    os.put("[1,2,3]");
+    EXPECT_FALSE(os.flush());
+    EXPECT_EQ(os.error(), EBADF);
+    os.put(std::string_view("a fragment larger than the buffer"));
+    EXPECT_EQ(os.close(), EBADF);
+}
+
+TEST(json_stream, iovec)
+{
+    std::string blob(1000, 'b');
+    std::string text = "{\"blob\":\"" + blob + "\",\"esc\":\"" + blob + "\\n" + blob +
+                       "\",\"small\":\"abc\",\"list\":[1,2,3]}";
+    Document doc;
+    ASSERT_EQ(doc.parse(text), PARSE_OK);
+
+    IovecWriteStream os;
+    Writer writer(os);
+    doc.writeTo(writer);
+    EXPECT_EQ(os.toString(), text);
+    EXPECT_EQ(os.size(), text.size());
+
+    // long runs point into the document, the rest is copied
+    const char* blobData = doc["blob"].getStringView().data();
+    const char* escData = doc["esc"].getStringView().data();
+    int refs = 0;
+    for (const iovec& seg: os.iov()) {
+        auto base = static_cast<const char*>(seg.iov_base);
+        if (base == blobData || base == escData || base == escData + blob.size() + 1)
+            refs++;
+    }
+    EXPECT_EQ(refs, 3);
+
+    // same output through the copying path
+    StringWriteStream copy;
+    Writer copyWriter(copy);
+    doc.writeTo(copyWriter);
+    EXPECT_EQ(os.toString(), copy.get());
+
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(os.writeTo(fileno(file)), 0);
+    EXPECT_EQ(readBack(file), text);
+    fclose(file);
+
+    os.clear();
+    EXPECT_EQ(os.size(), 0);
+    EXPECT_EQ(os.toString(), "");
+}
+
+TEST(json_stream, iovec_many_segments)
+{
+    // more segments than one writev() takes
+    Value doc(TYPE_ARRAY);
+    std::string blob(IovecWriteStream::kMinRef, 'x');
+    for (int i = 0; i < 3000; i++)
+        doc.addValue(Value(std::string_view(blob)));
+
+    IovecWriteStream os;
+    PrettyWriter writer(os, " ");
+    doc.writeTo(writer);
+
+    StringWriteStream copy;
+    PrettyWriter copyWriter(copy, " ");
+    doc.writeTo(copyWriter);
+
+    EXPECT_GT(os.iov().size(), 3000);
+    FILE* file = tmpfile();
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(os.writeTo(fileno(file)), 0);
+    EXPECT_EQ(readBack(file), copy.get());
+    fclose(file);
+
+    EXPECT_EQ(os.writeTo(-1), EBADF);
+}
+
+static std::string writeString(const Value& value)
+{
+    StringWriteStream os;
+    Writer writer(os);
+    value.writeTo(writer);
+    return std::string(os.get());
+}
+
+TEST(json_stream, fixed_buffer)
+{
+    Document doc;
+    ASSERT_EQ(doc.parse(R"({"s":"q\"u\\o\nt\u0001e","i":[-2147483648,9223372036854775807,-9223372036854775808],)"
+                        R"("d":[0.1,1e300,-2.5e-7],"deep":[[[[[[[[[[[[[[[[[[[[{"a":[true,false,null]}]]]]]]]]]]]]]]]]]]]]})"),
+              PARSE_OK);
+    Value special(TYPE_ARRAY);
+    special.addValue(Value(std::numeric_limits<double>::infinity()));
+    special.addValue(Value(std::numeric_limits<double>::quiet_NaN()));
+    doc.addMember("special", special);
+    // deeper than the Writer keeps in place
+    Value deeper(TYPE_ARRAY);
+    for (int i = 0; i < 40; i++) {
+        Value outer(TYPE_ARRAY);
+        outer.addValue(deeper);
+        deeper = outer;
+    }
+    doc.addMember("deeper", deeper);
+    std::string expect = writeString(doc);
+
+    // every capacity: the text fits, or a prefix of it and the size needed
+    std::string buffer(expect.size() + 8, '\0');
+    for (size_t capacity = 0; capacity <= buffer.size(); capacity++) {
+        FixedBufferWriteStream os(buffer.data(), capacity);
+        Writer writer(os);
+        doc.writeTo(writer);
+        EXPECT_EQ(os.required(), expect.size());
+        EXPECT_EQ(os.overflow(), capacity < expect.size());
+        if (os.overflow())
+            EXPECT_EQ(expect.compare(0, os.get().size(), os.get()), 0);
+        else
+            EXPECT_EQ(os.get(), expect);
+    }
+}
+
+TEST(json_stream, fixed_buffer_no_heap)
+{
+    Document doc;
+    ASSERT_EQ(doc.parse(R"({"id":42,"px":101.25,"qty":-7,"sym":"ABC\tD","flags":[true,null],"book":[[1,2],[3,4]]})"),
+              PARSE_OK);
+
+    char buffer[256];
+    size_t before = allocations;
+    FixedBufferWriteStream os(buffer);
+    Writer writer(os);
+    doc.writeTo(writer);
+    EXPECT_EQ(allocations, before);
+    EXPECT_FALSE(os.overflow());
+    EXPECT_EQ(os.get(), writeString(doc));
+
+    os.clear();
+    EXPECT_EQ(os.required(), 0);
+    EXPECT_EQ(os.get(), "");
+}
+
+template <template <typename> class Handler, typename... Args>
+static void expectSameAsSequential(const Value& value, Args... args)
+{
+    StringWriteStream expect;
+    Handler<StringWriteStream> handler(expect, args...);
+    value.writeTo(handler);
+    for (unsigned threads: { 1, 2, 3, 4, 7, 16 }) {
+        StringWriteStream os;
+        writeParallel<Handler>(value, os, threads, args...);
+        EXPECT_EQ(os.get(), expect.get()) << threads << " threads";
+    }
+}
+
+TEST(json_stream, parallel)
+{
+    std::string rows = "[";
+    for (int i = 0; i < 100; i++)
+        rows += (i > 0 ? ",{\"id\":" : "{\"id\":") + std::to_string(i) + ",\"tags\":[\"a\",\"b\"],\"v\":0.5}";
+    rows += "]";
+    std::string ring = "[";
+    for (int i = 0; i < 50; i++)
+        ring += (i > 0 ? ",[" : "[") + std::to_string(i) + ".25," + std::to_string(-i) + ".5]";
+    ring += "]";
+    std::string rings = "[" + ring + "," + ring + ",[]," + ring + "," + ring + "," + ring + "]";
+    std::string nested = R"({"type":"FeatureCollection","features":[{"type":"Feature","properties":{"name":"x"},)"
+                         R"("geometry":{"type":"Polygon","coordinates":)" + rings + "}}]}";
+    std::string members = "{";
+    for (int i = 0; i < 40; i++)
+        members += (i > 0 ? ",\"k" : "\"k") + std::to_string(i) + "\":{\"n\":[" + std::to_string(i) + "]}";
+    members += "}";
+
+    const std::string texts[] = { rows, nested, members, "[]", "{}", "[1,2]", "\"plain\"", "[[[1]]]" };
+    for (unsigned flags: { unsigned(FLAG_NONE), unsigned(FLAG_PACK_ARRAYS), unsigned(FLAG_LAZY_NUMBERS) }) {
+        for (const std::string& text: texts) {
+            Document doc(flags);
+            ASSERT_EQ(doc.parse(text), PARSE_OK) << text;
+            expectSameAsSequential<Writer>(doc);
+            expectSameAsSequential<PrettyWriter>(doc);
+            expectSameAsSequential<PrettyWriter>(doc, std::string_view(" "));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,6 +1,12 @@
 #include <gtest/gtest.h>
 
 #include <hjson/Document.h>
+#include <hjson/ImmutableDocument.h>
+#include <hjson/SharedDocument.h>
+#include <hjson/StringWriteStream.h>
+#include <hjson/Writer.h>
+
+#include <thread>
 
 using namespace json;
 
@@ -244,6 +250,646 @@ TEST(json_value, object)
     EXPECT_EQ(obj["3"].getInt32(), 3);
 }
 
+TEST(json_value, copy_on_write)
+{
+    Document doc;
+    ParseError err = doc.parse("{\"a\":[1,2,3],\"o\":{\"x\":1,\"y\":{\"z\":2}}}");
+    EXPECT_EQ(err, PARSE_OK);
+
+    const Value snapshot = doc;
+    const Value& origArray = snapshot["a"];
+    const Value& origY = snapshot["o"]["y"];
+
+    doc["a"].addValue(Value(4));
+    doc["a"][0].setInt32(100);
+    doc["o"]["x"].setString("changed");
+    doc["o"].addMember("w", true);
+
+    EXPECT_EQ(doc["a"].getSize(), 4);
+    EXPECT_EQ(doc["a"][0].getInt32(), 100);
+    EXPECT_EQ(doc["o"]["x"].getStringView(), "changed");
+    EXPECT_EQ(doc["o"].getSize(), 3);
+
+    EXPECT_EQ(snapshot["a"].getSize(), 3);
+    EXPECT_EQ(snapshot["a"][0].getInt32(), 1);
+    EXPECT_EQ(snapshot["o"]["x"].getInt32(), 1);
+    EXPECT_EQ(snapshot["o"].getSize(), 2);
+
+    // untouched subtrees stay shared with the snapshot
+    const Value& constDoc = doc;
+    EXPECT_EQ(&constDoc["o"]["y"].getObject(), &origY.getObject());
+    EXPECT_NE(&constDoc["a"].getArray(), &origArray.getArray());
+
+    // uniquely owned values are mutated in place
+    auto* before = &constDoc["a"].getArray();
+    doc["a"].addValue(Value(5));
+    EXPECT_EQ(&constDoc["a"].getArray(), before);
+}
+
+TEST(json_value, large_object)
+{
+    Value obj(TYPE_OBJECT);
+    for (int32_t i = 0; i < 1000; i++)
+        obj.addMember(Value(std::to_string(i)), Value(i));
+
+    const Value& cobj = obj;
+    EXPECT_EQ(cobj.getSize(), 1000);
+    for (int32_t i = 0; i < 1000; i++)
+        EXPECT_EQ(cobj[std::to_string(i)].getInt32(), i);
+    EXPECT_EQ(cobj.findMember("1000"), cobj.memberEnd());
+
+    EXPECT_TRUE(obj.removeMember("0"));
+    EXPECT_TRUE(obj.removeMember("500"));
+    EXPECT_FALSE(obj.removeMember("500"));
+    EXPECT_EQ(cobj.getSize(), 998);
+    EXPECT_EQ(cobj.findMember("500"), cobj.memberEnd());
+    EXPECT_EQ(cobj["501"].getInt32(), 501);
+    EXPECT_EQ(cobj.memberBegin()->key.getStringView(), "1");
+
+    Value copy = obj;
+    obj.addMember("new", 1);
+    EXPECT_EQ(cobj["new"].getInt32(), 1);
+    EXPECT_EQ(static_cast<const Value&>(copy).findMember("new"), copy.getObject().cend());
+    EXPECT_EQ(static_cast<const Value&>(copy)["999"].getInt32(), 999);
+
+    // shrinking below the index threshold falls back to a linear scan
+    Value small(TYPE_OBJECT);
+    for (int32_t i = 0; i < 20; i++)
+        small.addMember(Value(std::to_string(i)), Value(i));
+    for (int32_t i = 0; i < 15; i++)
+        EXPECT_TRUE(small.removeMember(std::to_string(i)));
+    EXPECT_EQ(small.getSize(), 5);
+    EXPECT_EQ(small["17"].getInt32(), 17);
+}
+
+TEST(json_value, large_object_index)
+{
+    std::string json = "{";
+    for (int i = 0; i < 20; i++)
+        json += (i > 0 ? ",\"k" : "\"k") + std::to_string(i) + "\":" + std::to_string(i);
+    json += "}";
+    Document doc;
+    ASSERT_EQ(doc.parse(json), PARSE_OK);
+    const Value& cdoc = doc;
+
+    // built by the first lookup, not by the parse
+    size_t parsed = doc.memoryUsage();
+    EXPECT_EQ(cdoc["k7"].getInt32(), 7);
+    EXPECT_GT(doc.memoryUsage(), parsed);
+    EXPECT_EQ(doc["k8"].getInt32(), 8);
+
+    // mutable lookups and iterators keep it, keys are read-only through them
+    size_t indexed = doc.memoryUsage();
+    for (int i = 0; i < 20; i++) {
+        std::string key = "k" + std::to_string(i);
+        auto it = doc.findMember(key);
+        ASSERT_NE(it, doc.memberEnd());
+        EXPECT_EQ(it->key.getStringView(), key);
+        it->value.setInt32(it->value.getInt32() * 2);
+        EXPECT_EQ(cdoc[key].getInt32(), i * 2);
+        EXPECT_EQ(doc.memoryUsage(), indexed);
+    }
+    for (auto it = doc.memberBegin(); it != doc.memberEnd(); ++it)
+        (*it).value.setInt32(it->value.getInt32() / 2);
+    EXPECT_EQ(cdoc["k1"].getInt32(), 1);
+    EXPECT_EQ(doc.findMember("missing"), doc.memberEnd());
+    EXPECT_EQ(doc.memoryUsage(), indexed);
+    EXPECT_EQ(cdoc["k19"].getInt32(), 19);
+
+    // kept up to date by addMember, dropped by removeMember
+    doc.addMember("k20", 20);
+    EXPECT_EQ(cdoc["k20"].getInt32(), 20);
+    EXPECT_TRUE(doc.removeMember("k10"));
+    EXPECT_EQ(cdoc.findMember("k10"), cdoc.memberEnd());
+    EXPECT_EQ(cdoc["k11"].getInt32(), 11);
+    EXPECT_EQ(cdoc["k20"].getInt32(), 20);
+}
+
+TEST(json_value, shared_keys)
+{
+    Document doc;
+    ParseError err = doc.parse("[{\"id\":1,\"name\":\"a\",\"tags\":[]},"
+                               " {\"id\":2,\"name\":\"b\",\"tags\":[]},"
+                               " {\"id\":3,\"name\":\"c\"},"
+                               " {\"name\":\"d\",\"id\":4,\"tags\":[]}]");
+    EXPECT_EQ(err, PARSE_OK);
+
+    const Value& cdoc = doc;
+    auto& first = cdoc[0].getObject();
+    auto& second = cdoc[1].getObject();
+    for (size_t i = 0; i < first.size(); i++) {
+        EXPECT_EQ(first[i].key.getStringView(), second[i].key.getStringView());
+        EXPECT_EQ(first[i].key.getStringView().data(), second[i].key.getStringView().data());
+    }
+    // a prefix of the key sequence still shares keys
+    EXPECT_EQ(cdoc[2].getObject()[1].key.getStringView().data(), first[1].key.getStringView().data());
+
+    for (int32_t i = 0; i < 4; i++) {
+        EXPECT_EQ(cdoc[i]["id"].getInt32(), i + 1);
+        EXPECT_EQ(cdoc[i]["name"].getString(), std::string(1, static_cast<char>('a' + i)));
+    }
+    EXPECT_EQ(cdoc[2].findMember("tags"), cdoc[2].memberEnd());
+    EXPECT_EQ(cdoc[3].getObject()[0].key.getStringView(), "name");
+
+    // mutating an object leaves the ones sharing its keys alone
+    doc[1].addMember("extra", true);
+    EXPECT_TRUE(doc[1].removeMember("id"));
+    EXPECT_EQ(cdoc[1]["extra"].getBool(), true);
+    EXPECT_EQ(cdoc[1].findMember("id"), cdoc[1].memberEnd());
+    EXPECT_EQ(cdoc[1]["tags"].getSize(), 0);
+    EXPECT_EQ(cdoc[0]["id"].getInt32(), 1);
+    EXPECT_EQ(cdoc[0].getSize(), 3);
+
+    // interned keys are not shared values
+    EXPECT_EQ(doc.stats().sharedNodes, 0);
+
+    // clear() lets go of them, the next parse does not hand out old keys
+    Value kept = cdoc[0];
+    doc.clear();
+    ASSERT_EQ(doc.parse("[{\"id\":1,\"name\":\"a\",\"tags\":[]}]"), PARSE_OK);
+    EXPECT_EQ(cdoc[0].getObject()[0].key.getStringView(), "id");
+    EXPECT_NE(cdoc[0].getObject()[0].key.getStringView().data(),
+              kept.getObject()[0].key.getStringView().data());
+}
+
+TEST(json_value, immutable_document)
+{
+    const char* json = "{\"n\":null,\"f\":false,\"t\":true,\"i\":-123,\"l\":9223372036854775807,"
+                       "\"d\":1.5,\"s\":\"a\\\"b\",\"a\":[1,[2,3],{}],\"o\":{\"x\":{\"y\":[]}}}";
+    ImmutableDocument doc;
+    ParseError err = doc.parse(json);
+    EXPECT_EQ(err, PARSE_OK);
+
+    auto root = doc.root();
+    EXPECT_EQ(root.getType(), TYPE_OBJECT);
+    EXPECT_EQ(root.getSize(), 9);
+    EXPECT_TRUE(root["n"].isNull());
+    EXPECT_FALSE(root["f"].getBool());
+    EXPECT_TRUE(root["t"].getBool());
+    EXPECT_EQ(root["i"].getInt32(), -123);
+    EXPECT_EQ(root["l"].getInt64(), std::numeric_limits<int64_t>::max());
+    EXPECT_EQ(root["d"].getDouble(), 1.5);
+    EXPECT_EQ(root["s"].getStringView(), "a\"b");
+    EXPECT_EQ(root["a"].getSize(), 3);
+    EXPECT_EQ(root["a"][1][1].getInt32(), 3);
+    EXPECT_EQ(root["a"][2].getSize(), 0);
+    EXPECT_EQ(root["o"]["x"]["y"].getSize(), 0);
+    EXPECT_EQ(root.findMember("missing"), root.memberEnd());
+
+    std::vector<std::string_view> keys;
+    for (auto it = root.memberBegin(); it != root.memberEnd(); ++it)
+        keys.push_back((*it).key.getStringView());
+    EXPECT_EQ(keys.size(), 9);
+    EXPECT_EQ(keys.front(), "n");
+    EXPECT_EQ(keys.back(), "o");
+
+    Document dom;
+    EXPECT_EQ(dom.parse(json), PARSE_OK);
+    StringWriteStream os1, os2;
+    Writer writer1(os1), writer2(os2);
+    dom.writeTo(writer1);
+    root.writeTo(writer2);
+    EXPECT_EQ(os1.get(), os2.get());
+
+    // a failed parse leaves the document empty, buffers are reused
+    EXPECT_EQ(doc.parse("[1, 2"), PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+    EXPECT_EQ(doc.parse("[1, 2]"), PARSE_OK);
+    EXPECT_EQ(doc.root()[1].getInt32(), 2);
+    // past 32-bit tape indices (not reachable in a test)
+    EXPECT_STREQ(parseErrorStr(PARSE_DOCUMENT_TOO_LARGE), "document too large");
+}
+
+TEST(json_value, document_reuse)
+{
+    const char* json = "{\"a\":[1,2,3],\"s\":\"a string longer than the small string buffer\","
+                       "\"o\":[{\"x\":1,\"y\":2},{\"x\":3,\"y\":4}]}";
+    Document doc;
+    EXPECT_EQ(doc.parse(json), PARSE_OK);
+
+    const Value& cdoc = doc;
+    auto* array = &cdoc["a"].getArray();
+    auto* object = &cdoc["o"][1].getObject();
+    auto* string = cdoc["s"].getStringView().data();
+
+    // a similar document gets the same nodes back
+    EXPECT_EQ(doc.parse(json), PARSE_OK);
+    EXPECT_EQ(&cdoc["a"].getArray(), array);
+    EXPECT_EQ(&cdoc["o"][1].getObject(), object);
+    EXPECT_EQ(cdoc["s"].getStringView().data(), string);
+    EXPECT_EQ(cdoc["o"][1]["y"].getInt32(), 4);
+
+    // nodes still referenced elsewhere are not recycled
+    Value kept = cdoc["a"];
+    doc.clear();
+    EXPECT_TRUE(doc.isNull());
+    EXPECT_EQ(doc.parse("[true]"), PARSE_OK);
+    EXPECT_EQ(doc.getSize(), 1);
+    EXPECT_EQ(kept.getSize(), 3);
+    EXPECT_EQ(kept[2].getInt32(), 3);
+
+    // a failed parse does not poison the next one
+    EXPECT_EQ(doc.parse("{\"a\":[1,"), PARSE_EXPECT_VALUE);
+    EXPECT_EQ(doc.parse(json), PARSE_OK);
+    EXPECT_EQ(cdoc["o"][0]["x"].getInt32(), 1);
+
+    doc.reset();
+    EXPECT_TRUE(doc.isNull());
+    EXPECT_EQ(doc.parse("[]"), PARSE_OK);
+    EXPECT_EQ(doc.getType(), TYPE_ARRAY);
+}
+
+TEST(json_value, reserve_exact)
+{
+    Document doc(FLAG_RESERVE_EXACT);
+    ParseError err = doc.parse("[ [], [ [1] , {} ], \"[,\\\",]\", {\"k,\":[1,2,3,4,5], \"{\":{ }},"
+                               "[1,2,3,4,5,6,7,8,9] ]");
+    EXPECT_EQ(err, PARSE_OK);
+
+    const Value& cdoc = doc;
+    EXPECT_EQ(cdoc.getArray().capacity(), 5);
+    EXPECT_EQ(cdoc[0].getArray().capacity(), 0);
+    EXPECT_EQ(cdoc[1].getArray().capacity(), 2);
+    EXPECT_EQ(cdoc[1][0].getArray().capacity(), 1);
+    EXPECT_EQ(cdoc[2].getStringView(), "[,\",]");
+    EXPECT_EQ(cdoc[3].getObject().capacity(), 2);
+    EXPECT_EQ(cdoc[3]["k,"].getArray().capacity(), 5);
+    EXPECT_EQ(cdoc[4].getArray().capacity(), 9);
+    EXPECT_EQ(cdoc[4][8].getInt32(), 9);
+
+    // streams are parsed without the pre-pass
+    StringReadStream is("[1,2,3]");
+    EXPECT_EQ(doc.parseStream(is), PARSE_OK);
+    EXPECT_EQ(doc.getSize(), 3);
+    EXPECT_EQ(doc.parse("[1,"), PARSE_EXPECT_VALUE);
+}
+
+TEST(json_value, memory_stats)
+{
+    Document doc(FLAG_RESERVE_EXACT);
+    ParseError err = doc.parse("[{\"a\":1,\"b\":\"x\"}, {\"a\":2,\"b\":\"y\"}, [1.5, null, true]]");
+    EXPECT_EQ(err, PARSE_OK);
+
+    MemoryStats stats = doc.stats();
+    EXPECT_EQ(stats.nodeCount[TYPE_ARRAY], 2);
+    EXPECT_EQ(stats.nodeCount[TYPE_OBJECT], 2);
+    EXPECT_EQ(stats.nodeCount[TYPE_STRING], 2);
+    EXPECT_EQ(stats.nodeCount[TYPE_INT32], 2);
+    EXPECT_EQ(stats.nodeCount[TYPE_DOUBLE], 1);
+    EXPECT_EQ(stats.nodeCount[TYPE_NULL], 1);
+    EXPECT_EQ(stats.nodeCount[TYPE_BOOL], 1);
+    EXPECT_EQ(stats.maxDepth, 2);
+    EXPECT_EQ(stats.slackBytes, 0);
+    EXPECT_GT(stats.stringBytes, 0);
+    EXPECT_EQ(stats.totalBytes, stats.stringBytes + stats.arrayBytes + stats.objectBytes);
+    EXPECT_EQ(doc.memoryUsage(), stats.totalBytes);
+
+    // a shared subtree is counted once
+    Value array(TYPE_ARRAY);
+    array.addValue(doc[2]);
+    array.addValue(doc[2]);
+    size_t one = Value(doc[2]).memoryUsage();
+    EXPECT_LT(array.memoryUsage(), 2 * one);
+
+    // recycled nodes show up as pool bytes
+    doc.clear();
+    EXPECT_EQ(doc.memoryUsage(), 0);
+    EXPECT_GT(doc.stats().totalBytes, 0);
+    doc.reset();
+    EXPECT_EQ(doc.stats().totalBytes, 0);
+}
+
+TEST(json_value, hash_and_equality)
+{
+    Document a, b;
+    EXPECT_EQ(a.parse("{\"x\":1, \"y\":[1.5, \"s\", null, true], \"z\":{}}"), PARSE_OK);
+    EXPECT_EQ(b.parse("{\"z\":{}, \"y\":[1.5, \"s\", null, true], \"x\":1}"), PARSE_OK);
+    EXPECT_TRUE(a == b);
+    EXPECT_EQ(a.hash(), b.hash());
+
+    EXPECT_TRUE(Value(int32_t(7)) == Value(int64_t(7)));
+    EXPECT_EQ(Value(int32_t(7)).hash(), Value(int64_t(7)).hash());
+    EXPECT_TRUE(Value(7.0) != Value(int32_t(7)));
+    EXPECT_TRUE(Value(0.0) == Value(-0.0));
+    EXPECT_EQ(Value(0.0).hash(), Value(-0.0).hash());
+
+    // the cached hash is dropped on mutation
+    Value c = a;
+    EXPECT_TRUE(c.sameStorage(a));
+    c["y"].addValue(Value(2));
+    EXPECT_FALSE(c.sameStorage(a));
+    EXPECT_NE(c.hash(), a.hash());
+    EXPECT_TRUE(c != a);
+    EXPECT_TRUE(a == b);
+
+    Value d(TYPE_ARRAY);
+    d.addValue(Value(1));
+    size_t h = d.hash();
+    d[0].setInt32(2);
+    EXPECT_NE(d.hash(), h);
+
+    // through a reference taken before hashing, ancestors included
+    Document e, f;
+    EXPECT_EQ(e.parse("{\"x\":{\"y\":1}}"), PARSE_OK);
+    EXPECT_EQ(f.parse("{\"x\":{\"y\":2}}"), PARSE_OK);
+    Value& y = e["x"]["y"];
+    h = e.hash();
+    EXPECT_TRUE(e != f);
+    y.setInt32(2);
+    EXPECT_TRUE(e == f);
+    EXPECT_EQ(e.hash(), f.hash());
+    EXPECT_NE(e.hash(), h);
+}
+
+TEST(json_value, copy_invalidates_references)
+{
+    Document doc;
+    ASSERT_EQ(doc.parse("{\"a\":[1]}"), PARSE_OK);
+
+    // a reference taken before the copy still points into the shared node
+    Value& stale = doc["a"];
+    Value snapshot = doc;
+    stale.addValue(Value(2));
+    EXPECT_EQ(snapshot["a"].getSize(), 2);
+
+    // taken again after the copy, it detaches first
+    Value snapshot2 = doc;
+    doc["a"].addValue(Value(3));
+    EXPECT_EQ(doc["a"].getSize(), 3);
+    EXPECT_EQ(snapshot2["a"].getSize(), 2);
+}
+
+TEST(json_value, deduplicate)
+{
+    std::string json = "[";
+    for (int i = 0; i < 100; i++) {
+        if (i > 0)
+            json += ",";
+        json += "{\"name\":\"item\", \"prices\":[1,2,3,4.5], \"tags\":[\"a\",\"b\"]}";
+    }
+    json += ", {\"prices\":[1,2,3,4.5], \"name\":\"item\", \"tags\":[\"a\",\"b\"]}]";
+
+    Document doc;
+    EXPECT_EQ(doc.parse(json), PARSE_OK);
+    Document copy;
+    EXPECT_EQ(copy.parse(json), PARSE_OK);
+
+    size_t before = doc.memoryUsage();
+    EXPECT_GT(doc.deduplicate(), 99);
+    EXPECT_LT(doc.memoryUsage() * 10, before);
+    EXPECT_TRUE(doc == copy);
+
+    const Value& cdoc = doc;
+    EXPECT_TRUE(cdoc[0].sameStorage(cdoc[99]));
+    // members in another order are equal but not merged
+    EXPECT_TRUE(cdoc[0] == cdoc[100]);
+    EXPECT_FALSE(cdoc[0].sameStorage(cdoc[100]));
+    EXPECT_TRUE(cdoc[0]["prices"].sameStorage(cdoc[100]["prices"]));
+    EXPECT_EQ(doc.deduplicate(), 0);
+
+    // merged nodes are copied on write
+    doc[1]["prices"].addValue(Value(5));
+    EXPECT_EQ(cdoc[0]["prices"].getSize(), 4);
+    EXPECT_EQ(cdoc[1]["prices"].getSize(), 5);
+    EXPECT_TRUE(doc != copy);
+}
+
+TEST(json_value, deduplicate_keeps_output)
+{
+    auto text = [](const Value& value) {
+        StringWriteStream os;
+        Writer writer(os);
+        value.writeTo(writer);
+        return std::string(os.get());
+    };
+
+    // equal, but written differently
+    const char* json = R"([[-0.0],[0.0],[1],[1.0],[1.00],[1.0]])";
+    for (unsigned flags: { 0u, unsigned(FLAG_LAZY_NUMBERS) }) {
+        Document doc(flags);
+        ASSERT_EQ(doc.parse(json), PARSE_OK);
+        std::string before = text(doc);
+        EXPECT_TRUE(doc[0] == doc[1]);
+        EXPECT_TRUE(doc[3] == doc[4]);
+        doc.deduplicate();
+        EXPECT_EQ(text(doc), before);
+        const Value& cdoc = doc;
+        EXPECT_FALSE(cdoc[0].sameStorage(cdoc[1]));
+        EXPECT_FALSE(cdoc[2].sameStorage(cdoc[3]));
+        EXPECT_EQ(cdoc[3].sameStorage(cdoc[4]), flags == 0);
+        EXPECT_TRUE(cdoc[3].sameStorage(cdoc[5]));
+    }
+
+    // int32 and int64 read back as different types
+    Document doc;
+    ASSERT_EQ(doc.parse("[[7],[7]]"), PARSE_OK);
+    doc[1][0].setInt64(7);
+    doc.deduplicate();
+    EXPECT_EQ(doc[1][0].getType(), TYPE_INT64);
+}
+
+TEST(json_value, shared_document)
+{
+    auto make = [](int64_t version) {
+        auto doc = std::make_unique<Document>();
+        doc->setObject();
+        doc->addMember("version", version);
+        doc->addMember("copy", version);
+        return doc;
+    };
+
+    SharedDocument<Document> shared;
+    EXPECT_FALSE(shared.pin());
+    shared.publish(make(0));
+    {
+        auto snapshot = shared.pin();
+        EXPECT_EQ((*snapshot)["version"].getInt64(), 0);
+        shared.publish(make(1));
+        // still pinned, the old one is kept
+        EXPECT_EQ(shared.retiredCount(), 1);
+        EXPECT_EQ((*snapshot)["version"].getInt64(), 0);
+        EXPECT_EQ((*shared.pin())["version"].getInt64(), 1);
+    }
+    shared.publish(make(2));
+    EXPECT_EQ(shared.retiredCount(), 0);
+
+    // readers always see a consistent snapshot, versions never go back
+    std::atomic<bool> stop{ false };
+    std::atomic<int> errors{ 0 };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&] {
+            int64_t last = 0;
+            while (!stop.load()) {
+                auto snapshot = shared.pin();
+                int64_t version = (*snapshot)["version"].getInt64();
+                if (version < last || (*snapshot)["copy"].getInt64() != version)
+                    errors++;
+                last = version;
+            }
+        });
+    }
+    for (int64_t version = 3; version < 2000; version++)
+        shared.publish(make(version));
+    stop = true;
+    for (auto& reader: readers)
+        reader.join();
+    EXPECT_EQ(errors.load(), 0);
+    shared.publish(make(0));
+    EXPECT_EQ(shared.retiredCount(), 0);
+}
+
+TEST(json_value, packed_array)
+{
+    Document doc(FLAG_PACK_ARRAYS);
+    ASSERT_EQ(doc.parse(R"({"d": [1.5, -2.25], "i": [1, 2, 3], "l": [1, 5000000000],
+                            "mixed": [1, 2.5], "s": ["x"], "e": []})"), PARSE_OK);
+    const Value& d = doc["d"];
+    EXPECT_EQ(d.getPackedType(), PACKED_DOUBLE);
+    EXPECT_EQ(doc["i"].getPackedType(), PACKED_INT32);
+    EXPECT_EQ(doc["l"].getPackedType(), PACKED_INT64);
+    EXPECT_EQ(doc["mixed"].getPackedType(), PACKED_NONE);
+    EXPECT_EQ(doc["s"].getPackedType(), PACKED_NONE);
+    EXPECT_EQ(doc["e"].getPackedType(), PACKED_NONE);
+
+    Document plain;
+    ASSERT_EQ(plain.parse(R"({"d": [1.5, -2.25], "i": [1, 2, 3], "l": [1, 5000000000],
+                              "mixed": [1, 2.5], "s": ["x"], "e": []})"), PARSE_OK);
+    EXPECT_LT(doc.stats().arrayBytes, plain.stats().arrayBytes);
+
+    auto view = d.getDoubleArray();
+    ASSERT_EQ(view.size(), 2);
+    EXPECT_EQ(view[0] + view[1], -0.75);
+    EXPECT_TRUE(d.getInt32Array().empty());
+    EXPECT_EQ(doc["l"].getInt64Array()[1], 5000000000);
+
+    // same output and semantics as unpacked arrays
+    EXPECT_EQ(doc.hash(), plain.hash());
+    EXPECT_TRUE(doc == plain);
+    StringWriteStream os1, os2;
+    Writer writer1(os1), writer2(os2);
+    doc.writeTo(writer1);
+    plain.writeTo(writer2);
+    EXPECT_EQ(os1.get(), os2.get());
+
+    EXPECT_EQ(d.getSize(), 2);
+    EXPECT_EQ(d[1].getDouble(), -2.25);
+    EXPECT_EQ(doc["l"][0].getInt32(), 1);
+    EXPECT_EQ(doc["i"].getArray().size(), 3);
+    EXPECT_EQ(d.getPackedType(), PACKED_DOUBLE); // unpacked, still packed
+
+    // mutation ends the packing, a copy keeps it
+    Value copy = doc["i"];
+    doc["i"].addValue(Value(4));
+    EXPECT_EQ(doc["i"].getPackedType(), PACKED_NONE);
+    EXPECT_EQ(doc["i"].getSize(), 4);
+    EXPECT_EQ(copy.getInt32Array().size(), 3);
+    EXPECT_TRUE(doc["i"].pack());
+    EXPECT_EQ(doc["i"].getInt32Array()[3], 4);
+    EXPECT_FALSE(doc["mixed"].pack());
+
+    Value floats(TYPE_ARRAY);
+    floats.addValue(Value(0.1));
+    EXPECT_TRUE(floats.pack(true));
+    EXPECT_EQ(floats[0].getDouble(), static_cast<double>(0.1f));
+
+    // rows share one buffer
+    ASSERT_EQ(doc.parse("[[1.5, 2.5], [3.5, 4.5], [5.5, 6.5]]"), PARSE_OK);
+    EXPECT_EQ(doc.getPackedType(), PACKED_DOUBLE);
+    EXPECT_EQ(doc.getPackedColumns(), 2);
+    EXPECT_EQ(doc.getSize(), 3);
+    EXPECT_EQ(doc.getDoubleArray().size(), 6);
+    EXPECT_EQ(doc.getDoubleArray()[3], 4.5);
+    StringWriteStream os3;
+    Writer writer3(os3);
+    doc.writeTo(writer3);
+    EXPECT_EQ(os3.get(), "[[1.5,2.5],[3.5,4.5],[5.5,6.5]]");
+    const Value& cdoc = doc;
+    EXPECT_EQ(cdoc[2][0].getDouble(), 5.5);
+    EXPECT_EQ(cdoc[2].getDoubleArray().size(), 2);
+    EXPECT_EQ(cdoc.getPackedColumns(), 2); // unpacked, still packed
+
+    ASSERT_EQ(doc.parse("[[1.5, 2], [3, 4], [5]]"), PARSE_OK);
+    EXPECT_EQ(doc.getPackedType(), PACKED_NONE);
+    EXPECT_EQ(doc[1].getInt32Array()[1], 4);
+
+    Document rows;
+    ASSERT_EQ(rows.parse("[[1, 2], [3, 4]]"), PARSE_OK);
+    Value shared = rows;
+    EXPECT_TRUE(rows.pack());
+    EXPECT_EQ(rows.getInt32Array().size(), 4);
+    EXPECT_EQ(shared[0].getPackedType(), PACKED_NONE);
+    EXPECT_TRUE(rows == shared);
+
+    // rows hash and compare from the buffer, the same as unpacked rows
+    EXPECT_TRUE(shared == rows);
+    EXPECT_EQ(rows.hash(), shared.hash());
+    Document other;
+    ASSERT_EQ(other.parse("[[1, 2], [3, 5]]"), PARSE_OK);
+    EXPECT_TRUE(other.pack());
+    EXPECT_FALSE(rows == other);
+    EXPECT_NE(rows.hash(), other.hash());
+    ASSERT_EQ(other.parse("[[1, 2, 3], [4, 5, 6]]"), PARSE_OK);
+    EXPECT_FALSE(rows == other);
+    EXPECT_TRUE(other.pack());
+    EXPECT_FALSE(rows == other);
+    ASSERT_EQ(other.parse("[1, 2]"), PARSE_OK);
+    EXPECT_FALSE(rows == other);
+    EXPECT_FALSE(other == rows);
+
+    // a uniquely owned packed array goes plain when mutated
+    static_cast<Value&>(rows).addValue(Value(TYPE_ARRAY));
+    EXPECT_EQ(rows.getPackedType(), PACKED_NONE);
+    EXPECT_EQ(rows.getSize(), 3);
+    EXPECT_EQ(rows[1][1].getInt32(), 4);
+    EXPECT_FALSE(rows == shared);
+}
+
+TEST(json_value, lazy_numbers)
+{
+    const char* json = R"({"a":1.10,"b":[2.5e3,-0.0,1E-7],"i":10,"big":1e400})";
+    Document doc(FLAG_LAZY_NUMBERS);
+    ASSERT_EQ(doc.parse(json), PARSE_OK);
+    EXPECT_EQ(doc["a"].getType(), TYPE_DOUBLE);
+    EXPECT_EQ(doc["a"].getRawNumber(), "1.10");
+    EXPECT_EQ(doc["i"].getRawNumber(), ""); // integers are not lazy
+    EXPECT_EQ(doc["a"].getDouble(), 1.1);
+    EXPECT_EQ(doc["a"].getDouble(), 1.1); // cached
+    EXPECT_EQ(doc["b"][0].getDouble(), 2500.0);
+
+    // written back verbatim
+    StringWriteStream os;
+    Writer writer(os);
+    doc.writeTo(writer);
+    EXPECT_EQ(os.get(), json);
+
+    // same value as an eager document
+    Document eager;
+    ASSERT_EQ(eager.parse(R"({"a":1.1,"b":[2500.0,0,1e-7],"i":10,"big":1e300})"), PARSE_OK);
+    eager["b"][1].setDouble(0.0);
+    eager["big"].setDouble(HUGE_VAL);
+    EXPECT_TRUE(doc == eager);
+    EXPECT_EQ(doc.hash(), eager.hash());
+
+    // copies outlive the document, a modified value loses its text
+    Value a = doc["a"];
+    Value b = doc["b"];
+    b[1].setDouble(-0.5);
+    doc.clear();
+    ASSERT_EQ(doc.parse("[3.25]"), PARSE_OK);
+    EXPECT_EQ(a.getRawNumber(), "1.10");
+    EXPECT_EQ(doc[0].getDouble(), 3.25);
+    StringWriteStream os2;
+    Writer writer2(os2);
+    b.writeTo(writer2);
+    EXPECT_EQ(os2.get(), "[2.5e3,-0.5,1E-7]");
+    EXPECT_GT(doc.stats().numberBytes, 0);
+
+    // the mode is off by default
+    Document plain;
+    ASSERT_EQ(plain.parse("1.10"), PARSE_OK);
+    EXPECT_EQ(plain.getRawNumber(), "");
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);